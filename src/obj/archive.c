@@ -0,0 +1,128 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ *  Nonogram - Terminal-based Nonogram solver
+ *  Copyright (C) 2001,2005-7,2012  Steven Simpson
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  Contact Steven Simpson <https://github.com/simpsonst>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "archive.h"
+#include "leword.h"
+
+#define TRAILERLEN (16 + ARCMAGICLEN)
+
+int archive_begin(struct archive *a, FILE *fp, size_t width, size_t height)
+{
+  unsigned char hdr[ARCMAGICLEN + 8];
+
+  a->offsets = NULL;
+  a->n = a->cap = 0;
+  memcpy(hdr, ARCMAGIC, ARCMAGICLEN);
+  leword_put(hdr + ARCMAGICLEN, width, 4);
+  leword_put(hdr + ARCMAGICLEN + 4, height, 4);
+  return fwrite(hdr, 1, sizeof hdr, fp) == sizeof hdr ? 0 : -1;
+}
+
+int archive_add(struct archive *a, FILE *fp)
+{
+  long pos = ftell(fp);
+
+  if (pos < 0)
+    return -1;
+  if (a->n == a->cap) {
+    size_t ncap = a->cap ? a->cap * 2 : 1024;
+    long *no = realloc(a->offsets, ncap * sizeof *no);
+    if (!no)
+      return -1;
+    a->offsets = no;
+    a->cap = ncap;
+  }
+  a->offsets[a->n++] = pos;
+  return 0;
+}
+
+/* The trailer gives the index's position, and the number of
+   solutions, and ends with the magic again. */
+int archive_end(struct archive *a, FILE *fp)
+{
+  unsigned char buf[TRAILERLEN];
+  long index = ftell(fp);
+  size_t i;
+  int rc = 0;
+
+  if (index < 0)
+    rc = -1;
+  for (i = 0; rc == 0 && i < a->n; i++) {
+    leword_put(buf, a->offsets[i], 8);
+    if (fwrite(buf, 1, 8, fp) != 8)
+      rc = -1;
+  }
+  if (rc == 0) {
+    leword_put(buf, index, 8);
+    leword_put(buf + 8, a->n, 8);
+    memcpy(buf + 16, ARCMAGIC, ARCMAGICLEN);
+    if (fwrite(buf, 1, TRAILERLEN, fp) != TRAILERLEN)
+      rc = -1;
+  }
+  free(a->offsets);
+  a->offsets = NULL;
+  a->n = a->cap = 0;
+  return rc;
+}
+
+int archive_extract(FILE *in, unsigned long long k, FILE *out,
+                    unsigned long long *count)
+{
+  unsigned char buf[65536];
+  long index, start, end;
+  size_t got;
+
+  /* Check the header, then find the index from the trailer. */
+  if (fseek(in, 0, SEEK_SET) != 0 ||
+      fread(buf, 1, ARCMAGICLEN, in) != ARCMAGICLEN ||
+      memcmp(buf, ARCMAGIC, ARCMAGICLEN) ||
+      fseek(in, -TRAILERLEN, SEEK_END) != 0 ||
+      fread(buf, 1, TRAILERLEN, in) != TRAILERLEN ||
+      memcmp(buf + 16, ARCMAGIC, ARCMAGICLEN))
+    return -1;
+  index = leword_get(buf, 8);
+  *count = leword_get(buf + 8, 8);
+  if (k < 1 || k > *count)
+    return 1;
+
+  /* The solution ends where the next starts, or at the index. */
+  if (fseek(in, index + (k - 1) * 8, SEEK_SET) != 0 ||
+      fread(buf, 1, k < *count ? 16 : 8, in) != (k < *count ? 16 : 8))
+    return -1;
+  start = leword_get(buf, 8);
+  end = k < *count ? (long) leword_get(buf + 8, 8) : index;
+  if (end < start || fseek(in, start, SEEK_SET) != 0)
+    return -1;
+
+  while (start < end) {
+    got = fread(buf, 1, end - start < (long) sizeof buf ?
+                (size_t) (end - start) : sizeof buf, in);
+    if (got == 0 || fwrite(buf, 1, got, out) != got)
+      return -1;
+    start += got;
+  }
+  return 0;
+}
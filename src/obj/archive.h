@@ -0,0 +1,58 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ *  Nonogram - Terminal-based Nonogram solver
+ *  Copyright (C) 2001,2005-7,2012  Steven Simpson
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  Contact Steven Simpson <https://github.com/simpsonst>
+ */
+
+#ifndef ARCHIVE_HEADER
+#define ARCHIVE_HEADER
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* A solution archive (-oa) holds all of a puzzle's solutions in one
+   file: a header giving the dimensions, each solution as it would be
+   written to its own file by -on, an index of where each starts, and
+   a trailer locating the index.  Multi-byte fields are little-endian.
+   Solution k is found by reading the trailer and one index entry. */
+#define ARCMAGIC "NONOARC1"
+#define ARCMAGICLEN 8
+
+/* where the solutions written so far start */
+struct archive {
+  long *offsets;
+  size_t n, cap;
+};
+
+int archive_begin(struct archive *a, FILE *fp, size_t width, size_t height);
+
+/* Note the start of a solution about to be written. */
+int archive_add(struct archive *a, FILE *fp);
+
+/* Write the index and trailer, and forget the offsets. */
+int archive_end(struct archive *a, FILE *fp);
+
+/* Copy solution k (from 1) of an archive.  Returns 1 if there is no
+   such solution, setting *count to the number there are, or -1 on
+   error. */
+int archive_extract(FILE *in, unsigned long long k, FILE *out,
+                    unsigned long long *count);
+
+#endif
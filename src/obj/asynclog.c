@@ -0,0 +1,199 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ *  Nonogram - Terminal-based Nonogram solver
+ *  Copyright (C) 2001,2005-7,2012  Steven Simpson
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  Contact Steven Simpson <https://github.com/simpsonst>
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "options.h"
+#include "asynclog.h"
+
+#if !defined(NOTHREADS) && defined(__GLIBC__)
+#include <sys/types.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+/* A ring with one writer at a time (the stream's own lock sees to
+   that) and one reader.  The positions only increase; each side
+   sleeps only when the ring is empty or full, and the other wakes it
+   only if it has said it is sleeping. */
+struct asynclog {
+  FILE *out;
+  char *buf;
+  size_t size;
+  atomic_size_t head, tail;
+  atomic_int idle, full;
+  pthread_mutex_t lock;
+  pthread_cond_t ready, drained;
+  pthread_t thread;
+  unsigned closing : 1;
+};
+
+static void *drain(void *vp)
+{
+  struct asynclog *al = vp;
+  size_t head, tail, n;
+
+  for (;;) {
+    tail = atomic_load(&al->tail);
+    head = atomic_load(&al->head);
+    if (head == tail) {
+      int done;
+
+      fflush(al->out);
+      pthread_mutex_lock(&al->lock);
+      atomic_store(&al->idle, 1);
+      while (atomic_load(&al->head) == tail && !al->closing)
+        pthread_cond_wait(&al->ready, &al->lock);
+      atomic_store(&al->idle, 0);
+      done = atomic_load(&al->head) == tail;
+      pthread_mutex_unlock(&al->lock);
+      if (done)
+        break;
+      continue;
+    }
+
+    /* Write up to the end of the buffer at most. */
+    n = head - tail;
+    if (n > al->size - tail % al->size)
+      n = al->size - tail % al->size;
+    fwrite(al->buf + tail % al->size, 1, n, al->out);
+    atomic_store(&al->tail, tail + n);
+    if (atomic_load(&al->full)) {
+      pthread_mutex_lock(&al->lock);
+      pthread_cond_signal(&al->drained);
+      pthread_mutex_unlock(&al->lock);
+    }
+  }
+  return NULL;
+}
+
+static ssize_t logwrite(void *cookie, const char *data, size_t len)
+{
+  struct asynclog *al = cookie;
+  size_t done = 0, head, space, n;
+
+  while (done < len) {
+    head = atomic_load(&al->head);
+    space = al->size - (head - atomic_load(&al->tail));
+    if (space == 0) {
+      pthread_mutex_lock(&al->lock);
+      atomic_store(&al->full, 1);
+      while (al->size - (head - atomic_load(&al->tail)) == 0)
+        pthread_cond_wait(&al->drained, &al->lock);
+      atomic_store(&al->full, 0);
+      pthread_mutex_unlock(&al->lock);
+      continue;
+    }
+
+    if (n = len - done, n > space)
+      n = space;
+    if (n > al->size - head % al->size)
+      n = al->size - head % al->size;
+    memcpy(al->buf + head % al->size, data + done, n);
+    atomic_store(&al->head, head + n);
+    done += n;
+    if (atomic_load(&al->idle)) {
+      pthread_mutex_lock(&al->lock);
+      pthread_cond_signal(&al->ready);
+      pthread_mutex_unlock(&al->lock);
+    }
+  }
+  return len;
+}
+
+static int logclose(void *cookie)
+{
+  struct asynclog *al = cookie;
+  int rc;
+
+  pthread_mutex_lock(&al->lock);
+  al->closing = 1;
+  pthread_cond_signal(&al->ready);
+  pthread_mutex_unlock(&al->lock);
+  pthread_join(al->thread, NULL);
+
+  rc = fclose(al->out);
+  pthread_cond_destroy(&al->drained);
+  pthread_cond_destroy(&al->ready);
+  pthread_mutex_destroy(&al->lock);
+  free(al->buf);
+  free(al);
+  return rc;
+}
+
+FILE *asynclog_open(FILE *out, size_t size)
+{
+  static const cookie_io_functions_t funcs = {
+    NULL, &logwrite, NULL, &logclose
+  };
+  struct asynclog *al;
+  FILE *fp;
+
+  if (size == 0 || !(al = malloc(sizeof *al)))
+    return out;
+  if (!(al->buf = malloc(size))) {
+    free(al);
+    return out;
+  }
+  al->out = out;
+  al->size = size;
+  atomic_init(&al->head, 0);
+  atomic_init(&al->tail, 0);
+  atomic_init(&al->idle, 0);
+  atomic_init(&al->full, 0);
+  al->closing = 0;
+  pthread_mutex_init(&al->lock, NULL);
+  pthread_cond_init(&al->ready, NULL);
+  pthread_cond_init(&al->drained, NULL);
+  if (pthread_create(&al->thread, NULL, &drain, al))
+    goto failed;
+  if (!(fp = fopencookie(al, "w", funcs))) {
+    pthread_mutex_lock(&al->lock);
+    al->closing = 1;
+    pthread_cond_signal(&al->ready);
+    pthread_mutex_unlock(&al->lock);
+    pthread_join(al->thread, NULL);
+    goto failed;
+  }
+  return fp;
+
+failed:
+  pthread_cond_destroy(&al->drained);
+  pthread_cond_destroy(&al->ready);
+  pthread_mutex_destroy(&al->lock);
+  free(al->buf);
+  free(al);
+  return out;
+}
+
+#else
+
+FILE *asynclog_open(FILE *out, size_t size)
+{
+  return out;
+}
+
+#endif
@@ -0,0 +1,36 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ *  Nonogram - Terminal-based Nonogram solver
+ *  Copyright (C) 2001,2005-7,2012  Steven Simpson
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  Contact Steven Simpson <https://github.com/simpsonst>
+ */
+
+#ifndef ASYNCLOG_HEADER
+#define ASYNCLOG_HEADER
+
+#include <stdio.h>
+
+/* Return a stream whose output is copied into a ring buffer of the
+   given size, and written to out by a background thread, so that
+   writers only wait when the buffer is full.  Closing the stream
+   writes what remains and closes out.  Where there are no threads, or
+   such streams can't be made, out itself is returned. */
+FILE *asynclog_open(FILE *out, size_t size);
+
+#endif
@@ -0,0 +1,338 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ *  Nonogram - Terminal-based Nonogram solver
+ *  Copyright (C) 2001,2005-7,2012  Steven Simpson
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  Contact Steven Simpson <https://github.com/simpsonst>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "context.h"
+#include "options.h"
+#include "cache.h"
+#include "mapping.h"
+
+#ifndef NOTHREADS
+#include <pthread.h>
+#endif
+
+#ifndef NOFSYNC
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+/* The file starts with a header, followed by records of this form,
+   each followed by its key, its grids, and padding to a multiple of
+   8 bytes.  Fields are in host byte order, so the header also holds
+   a known word to detect files from elsewhere. */
+struct record {
+  uint32_t reclen, keylen, width, height;
+  uint64_t count;
+  uint32_t stored, complete;
+};
+
+static const char magic[12] = "nonocache01\n";
+#define ORDER 0x01020304UL
+#define HEADLEN 16
+
+struct added {
+  struct added *next;
+  uint64_t data[1];
+};
+
+struct cache {
+  struct mapping map;
+  FILE *out;
+  const struct record **slots;
+  size_t nslots, used;
+  struct added *added;
+#ifndef NOTHREADS
+  pthread_mutex_t lock;
+#endif
+};
+
+static uint64_t hashkey(const char *key, size_t len)
+{
+  uint64_t h = 14695981039346656037ULL;
+
+  while (len-- > 0) {
+    h ^= (unsigned char) *key++;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static const char *reckey(const struct record *r)
+{
+  return (const char *) (r + 1);
+}
+
+static size_t reclength(size_t keylen, size_t gridbytes)
+{
+  return (sizeof(struct record) + keylen + gridbytes + 7) & ~(size_t) 7;
+}
+
+/* Does the record answer more than the one it would replace? */
+static int better(const struct record *r, const struct record *old)
+{
+  if (r->complete != old->complete)
+    return r->complete;
+  return r->count > old->count || r->stored > old->stored;
+}
+
+/* Returns 1 if the record was indexed, 0 if an existing one for the
+   same puzzle is at least as good. */
+static int index_record(struct cache *c, const struct record *r)
+{
+  size_t i;
+
+  if ((c->used + 1) * 2 > c->nslots) {
+    size_t n = c->nslots ? c->nslots * 2 : 1024;
+    const struct record **ns = calloc(n, sizeof *ns);
+    if (!ns)
+      return -1;
+    for (i = 0; i < c->nslots; i++)
+      if (c->slots[i]) {
+        size_t j = hashkey(reckey(c->slots[i]), c->slots[i]->keylen) % n;
+        while (ns[j])
+          j = (j + 1) % n;
+        ns[j] = c->slots[i];
+      }
+    free(c->slots);
+    c->slots = ns;
+    c->nslots = n;
+  }
+
+  for (i = hashkey(reckey(r), r->keylen) % c->nslots; c->slots[i];
+       i = (i + 1) % c->nslots)
+    if (c->slots[i]->keylen == r->keylen &&
+        !memcmp(reckey(c->slots[i]), reckey(r), r->keylen)) {
+      if (!better(r, c->slots[i]))
+        return 0;
+      c->slots[i] = r;
+      return 1;
+    }
+  c->slots[i] = r;
+  c->used++;
+  return 1;
+}
+
+/* Other processes sharing the file are kept out while it is read or
+   written. */
+static int lockfile(FILE *fp, int on)
+{
+#ifndef NOFSYNC
+  struct flock fl;
+
+  fl.l_type = on ? F_WRLCK : F_UNLCK;
+  fl.l_whence = SEEK_SET;
+  fl.l_start = 0;
+  fl.l_len = 0;
+  while (fcntl(fileno(fp), F_SETLKW, &fl) < 0)
+    if (errno != EINTR)
+      return -1;
+#endif
+  return 0;
+}
+
+struct cache *cache_open(const char *path)
+{
+  struct cache *c = malloc(sizeof *c);
+  size_t pos;
+  uint32_t order = ORDER;
+
+  if (!c)
+    return NULL;
+  c->slots = NULL;
+  c->nslots = c->used = 0;
+  c->added = NULL;
+  c->map.start = NULL;
+  c->map.mapped = false;
+  c->map.len = 0;
+
+  c->out = fopen(path, "a+b");
+  if (!c->out) {
+    fprintf(stderr, "%s: could not open\n", path);
+    free(c);
+    return NULL;
+  }
+  if (lockfile(c->out, true) < 0 || fseek(c->out, 0, SEEK_SET) != 0 ||
+      map_stream(&c->map, c->out) < 0) {
+    fclose(c->out);
+    free(c);
+    return NULL;
+  }
+  if (c->map.len > 0 &&
+      (c->map.len < HEADLEN || memcmp(c->map.base, magic, sizeof magic) ||
+       memcmp(c->map.base + sizeof magic, &order, sizeof order))) {
+    fprintf(stderr, "%s: not a solution cache\n", path);
+    goto fail;
+  }
+
+  /* index what is already there, stopping at anything truncated */
+  for (pos = HEADLEN; pos + sizeof(struct record) <= c->map.len; ) {
+    const struct record *r = (const struct record *) (c->map.base + pos);
+    if (r->reclen < sizeof *r || r->reclen > c->map.len - pos ||
+        reclength(r->keylen, (size_t) r->stored * r->width * r->height *
+                  sizeof(nonogram_cell)) != r->reclen)
+      break;
+    if (index_record(c, r) < 0)
+      goto fail;
+    pos += r->reclen;
+  }
+
+  /* A write cut short leaves a damaged record at the end, which would
+     hide all those appended after it. */
+  if (c->map.len > 0 && pos < c->map.len) {
+#ifndef NOFSYNC
+    fprintf(stderr, "%s: dropping a damaged record\n", path);
+    if (ftruncate(fileno(c->out), pos) != 0)
+      goto fail;
+#else
+    fprintf(stderr, "%s: damaged record; later ones are ignored\n", path);
+#endif
+  }
+
+  if (c->map.len == 0) {
+    fwrite(magic, 1, sizeof magic, c->out);
+    fwrite(&order, 1, sizeof order, c->out);
+  }
+  if (fflush(c->out) == EOF)
+    goto fail;
+  lockfile(c->out, false);
+
+#ifndef NOTHREADS
+  pthread_mutex_init(&c->lock, NULL);
+#endif
+  return c;
+
+fail:
+  fclose(c->out);
+  free(c->slots);
+  unmap_stream(&c->map);
+  free(c);
+  return NULL;
+}
+
+void cache_close(struct cache *c)
+{
+  if (!c)
+    return;
+  if (c->out) {
+    fclose(c->out);
+#ifndef NOTHREADS
+    pthread_mutex_destroy(&c->lock);
+#endif
+  }
+  while (c->added) {
+    struct added *next = c->added->next;
+    free(c->added);
+    c->added = next;
+  }
+  free(c->slots);
+  if (c->map.start)
+    unmap_stream(&c->map);
+  free(c);
+}
+
+int cache_find(struct cache *c, const char *key, size_t keylen,
+               struct cacheentry *e)
+{
+  const struct record *r = NULL;
+  size_t i;
+
+#ifndef NOTHREADS
+  pthread_mutex_lock(&c->lock);
+#endif
+  if (c->nslots > 0)
+    for (i = hashkey(key, keylen) % c->nslots; c->slots[i];
+         i = (i + 1) % c->nslots)
+      if (c->slots[i]->keylen == keylen &&
+          !memcmp(reckey(c->slots[i]), key, keylen)) {
+        r = c->slots[i];
+        break;
+      }
+#ifndef NOTHREADS
+  pthread_mutex_unlock(&c->lock);
+#endif
+
+  if (!r)
+    return 0;
+  e->count = r->count;
+  e->width = r->width;
+  e->height = r->height;
+  e->stored = r->stored;
+  e->complete = r->complete != 0;
+  e->grids = (const nonogram_cell *) (reckey(r) + r->keylen);
+  return 1;
+}
+
+int cache_add(struct cache *c, const char *key, size_t keylen,
+              const struct cacheentry *e)
+{
+  size_t gridbytes = e->stored * e->width * e->height * sizeof(nonogram_cell);
+  size_t len = reclength(keylen, gridbytes);
+  struct added *a;
+  struct record *r;
+  int rc = 0;
+
+  a = malloc(offsetof(struct added, data) + len);
+  if (!a)
+    return -1;
+  r = (struct record *) a->data;
+  memset(r, 0, len);
+  r->reclen = len;
+  r->keylen = keylen;
+  r->width = e->width;
+  r->height = e->height;
+  r->count = e->count;
+  r->stored = e->stored;
+  r->complete = e->complete;
+  memcpy(r + 1, key, keylen);
+  memcpy((char *) (r + 1) + keylen, e->grids, gridbytes);
+
+#ifndef NOTHREADS
+  pthread_mutex_lock(&c->lock);
+#endif
+  switch (index_record(c, r)) {
+  case 1:
+    a->next = c->added;
+    c->added = a;
+    if (lockfile(c->out, true) < 0 ||
+        fwrite(r, 1, len, c->out) != len || fflush(c->out) == EOF)
+      rc = -1;
+    lockfile(c->out, false);
+    break;
+  case 0:
+    free(a);
+    break;
+  default:
+    free(a);
+    rc = -1;
+    break;
+  }
+#ifndef NOTHREADS
+  pthread_mutex_unlock(&c->lock);
+#endif
+  return rc;
+}
@@ -0,0 +1,51 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ *  Nonogram - Terminal-based Nonogram solver
+ *  Copyright (C) 2001,2005-7,2012  Steven Simpson
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  Contact Steven Simpson <https://github.com/simpsonst>
+ */
+
+#ifndef CACHE_HEADER
+#define CACHE_HEADER
+
+#include <nonogram.h>
+
+/* A file of puzzles already solved, keyed by their nonocache
+   encoding.  New results are appended, so several runs may share
+   one. */
+struct cache;
+
+struct cacheentry {
+  unsigned long long count;
+  size_t width, height, stored;
+  const nonogram_cell *grids;
+  unsigned complete : 1;
+};
+
+struct cache *cache_open(const char *path);
+void cache_close(struct cache *);
+int cache_find(struct cache *, const char *key, size_t keylen,
+               struct cacheentry *e);
+int cache_add(struct cache *, const char *key, size_t keylen,
+              const struct cacheentry *e);
+
+/* Don't keep grids beyond this many bytes per puzzle; just count. */
+#define CACHE_MAXGRIDBYTES (1024 * 1024)
+
+#endif
@@ -0,0 +1,102 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ *  Nonogram - Terminal-based Nonogram solver
+ *  Copyright (C) 2001,2005-7,2012  Steven Simpson
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  Contact Steven Simpson <https://github.com/simpsonst>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "options.h"
+
+#ifndef NOFSYNC
+#include <unistd.h>
+#endif
+
+#include "checkpoint.h"
+
+static const char magic[] = "nonogram checkpoint 1\n";
+
+int checkpoint_write(const char *path, const struct checkpoint *cp)
+{
+  size_t len = strlen(path);
+  char *tmp = malloc(len + 5);
+  FILE *fp;
+  int rc;
+
+  if (!tmp)
+    return -1;
+  memcpy(tmp, path, len);
+  strcpy(tmp + len, ".tmp");
+
+  fp = fopen(tmp, "w");
+  if (!fp) {
+    free(tmp);
+    return -1;
+  }
+  fputs(magic, fp);
+  fprintf(fp, "solver %s\nsolutions %llu\nsteps %llu\noutput %ld\n"
+          "state %s\npuzzle %zu\n", cp->solver, cp->solutions, cp->steps,
+          cp->output, cp->done ? "done" : "running", cp->keylen);
+  fwrite(cp->key, 1, cp->keylen, fp);
+  putc('\n', fp);
+  rc = fflush(fp) == 0 && !ferror(fp) ? 0 : -1;
+#ifndef NOFSYNC
+  if (rc == 0 && fsync(fileno(fp)) != 0)
+    rc = -1;
+#endif
+  if (fclose(fp) != 0)
+    rc = -1;
+  if (rc == 0 && rename(tmp, path) != 0)
+    rc = -1;
+  if (rc < 0)
+    remove(tmp);
+  free(tmp);
+  return rc;
+}
+
+int checkpoint_read(const char *path, struct checkpoint *cp,
+                    char *solver)
+{
+  char line[sizeof magic], state[10];
+  FILE *fp = fopen(path, "r");
+
+  if (!fp)
+    return errno == ENOENT ? 1 : -1;
+  cp->key = NULL;
+  if (!fgets(line, sizeof line, fp) || strcmp(line, magic) ||
+      fscanf(fp, "solver %40s solutions %llu steps %llu output %ld "
+             "state %9s puzzle %zu", solver, &cp->solutions, &cp->steps,
+             &cp->output, state, &cp->keylen) != 6 ||
+      getc(fp) != '\n' ||
+      !(cp->key = malloc(cp->keylen + 1)) ||
+      fread(cp->key, 1, cp->keylen, fp) != cp->keylen) {
+    free(cp->key);
+    fclose(fp);
+    return -1;
+  }
+  fclose(fp);
+  cp->key[cp->keylen] = '\0';
+  cp->solver = solver;
+  cp->done = !strcmp(state, "done");
+  return 0;
+}
@@ -0,0 +1,59 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ *  Nonogram - Terminal-based Nonogram solver
+ *  Copyright (C) 2001,2005-7,2012  Steven Simpson
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  Contact Steven Simpson <https://github.com/simpsonst>
+ */
+
+#ifndef CHECKPOINT_HEADER
+#define CHECKPOINT_HEADER
+
+#include <stddef.h>
+
+/* A record of how far a search has got, so that a run cut short can
+   be resumed without writing its solutions again.  The solver's own
+   state can't be saved, so a resumed search starts again, and passes
+   over as many solutions as were recorded.  The length of the output
+   file then is kept too (or -1), so that anything written after it
+   can be cut off. */
+struct checkpoint {
+  char *key;
+  size_t keylen;
+  const char *solver;
+  unsigned long long solutions, steps;
+  long output;
+  unsigned done : 1;
+};
+
+/* Replace the file with a new record, so that it is never seen half
+   written. */
+int checkpoint_write(const char *path, const struct checkpoint *cp);
+
+/* Read a record, returning 1 if there is none, and setting cp->key to
+   memory to be freed, and cp->solver to a string no longer than
+   CHECKPOINT_MAXNAME. */
+int checkpoint_read(const char *path, struct checkpoint *cp,
+                    char *solver);
+
+#define CHECKPOINT_MAXNAME 40
+
+/* seconds between records */
+#define CHECKPOINT_PERIOD 10.0
+
+#endif
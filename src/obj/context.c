@@ -22,9 +22,11 @@
  */
 
 #include <time.h>
+#include <errno.h>
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <limits.h>
 
 #include <nonogram.h>
 #include <nonocache.h>
@@ -33,6 +35,20 @@
 #include "context.h"
 #include "options.h"
 #include "display.h"
+#include "pool.h"
+#include "timing.h"
+#include "cache.h"
+#include "mapping.h"
+#include "json.h"
+#include "quantum.h"
+#include "monitor.h"
+#include "checkpoint.h"
+#include "archive.h"
+#include "asynclog.h"
+#include "jobs.h"
+#include "encoding.h"
+
+#include <unistd.h>
 
 const char *PTRCONST default_html_dot = "icons/dot.xbm";
 const char *PTRCONST default_html_solid = "icons/solid.xbm";
@@ -40,10 +56,87 @@ const char *PTRCONST default_html_blank = "icons/blank.xbm";
 const char *PTRCONST default_dot = "-";
 const char *PTRCONST default_solid = "#";
 const char *PTRCONST default_blank = " ";
+const char *PTRCONST default_unknown = "?";
 
 nonogram_cell *loadgrid(size_t *width, size_t *height,
                         FILE *fp, char solid, char dot);
 
+/* Read the next puzzle from a stream, either in the text format, or
+   as a line holding its encoding (from -penc) with -enc. */
+static int readpuzzle(const context *c, nonogram_puzzle *puzzle, FILE *fp)
+{
+  char *line = NULL;
+  size_t cap = 0;
+  ssize_t len;
+  int rc;
+
+  if (!c->encoded)
+    return nonogram_fscanpuzzle(puzzle, fp);
+
+  /* Skip blank lines, and drop the line ending. */
+  do {
+    len = getline(&line, &cap, fp);
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+      len--;
+  } while (len == 0);
+  rc = len < 0 ? -1 : encoding_read(puzzle, line, len);
+  free(line);
+  return rc;
+}
+
+/* Get the puzzle from the input, parsing it only if no earlier action
+   has. */
+static nonogram_puzzle *getpuzzle(context *c, const char *progname)
+{
+  FILE *fin;
+
+  if (c->loaded)
+    return &c->puzzle;
+
+  if (c->ifile) {
+    fin = fopen(c->ifile, "r");
+    if (!fin) {
+      fprintf(stderr, "%s: could not read\n", c->ifile);
+      return NULL;
+    }
+  } else {
+    fin = c->in;
+  }
+
+  if (readpuzzle(c, &c->puzzle, fin) < 0) {
+    if (c->ifile)
+      fclose(fin);
+    fprintf(stderr, "%s: error on input\n", progname);
+    return NULL;
+  }
+  if (fin && fin != c->in)
+    fclose(fin);
+
+  c->loaded = true;
+  return &c->puzzle;
+}
+
+/* Take the puzzle for an action that changes or uses it up, so that
+   the next action reads the input again. */
+static int takepuzzle(context *c, const char *progname,
+                      nonogram_puzzle *puzzle)
+{
+  if (!getpuzzle(c, progname))
+    return -1;
+  *puzzle = c->puzzle;
+  c->loaded = false;
+  return 0;
+}
+
+/* Forget any parsed puzzle, when the input changes or is read in
+   another way. */
+void droppuzzle(context *c)
+{
+  if (c->loaded)
+    nonogram_freepuzzle(&c->puzzle);
+  c->loaded = false;
+}
+
 int create(context *c, const char *progname)
 {
   FILE *fin, *fout;
@@ -51,6 +144,7 @@ int create(context *c, const char *progname)
   nonogram_cell *g;
   size_t w, h;
 
+  droppuzzle(c);
   if (c->ifile) {
     fin = fopen(c->ifile, "r");
     if (!fin) {
@@ -58,7 +152,7 @@ int create(context *c, const char *progname)
       return -1;
     }
   } else {
-    fin = stdin;
+    fin = c->in;
   }
 
   if (!(g = loadgrid(&w, &h, fin, *c->solid, *c->dot))) {
@@ -67,7 +161,7 @@ int create(context *c, const char *progname)
     fprintf(stderr, "%s: error on input\n", progname);
     return -1;
   }
-  if (fin && fin != stdin)
+  if (fin && fin != c->in)
     fclose(fin);
 
   if (nonogram_makepuzzle(&puzzle, g, w, h) < 0) {
@@ -90,9 +184,10 @@ int create(context *c, const char *progname)
     }
     break;
   case STDSTREAM:
-    fout = stdout;
+    fout = c->out;
     break;
   case MULTIPLE:
+  case ARCHIVE:
     fprintf(stderr, "%s: inappropriate output (use -o, -os or +o)\n",
             progname);
     nonogram_freepuzzle(&puzzle);
@@ -103,7 +198,7 @@ int create(context *c, const char *progname)
   }
 
   nonogram_fprintpuzzle(&puzzle, fout);
-  if (fout && fout != stdout)
+  if (fout && fout != c->out)
     fclose(fout);
 
   nonogram_freepuzzle(&puzzle);
@@ -112,36 +207,18 @@ int create(context *c, const char *progname)
 
 int verify(context *c, const char *progname)
 {
-  FILE *fin;
-  nonogram_puzzle puzzle;
+  nonogram_puzzle *puzzle;
   int diff;
 
-  if (c->ifile) {
-    fin = fopen(c->ifile, "r");
-    if (!fin) {
-      fprintf(stderr, "%s: could not read\n", c->ifile);
-      return -1;
-    }
-  } else {
-    fin = stdin;
-  }
-
-  if (nonogram_fscanpuzzle(&puzzle, fin) < 0) {
-    if (c->ifile)
-      fclose(fin);
-    fprintf(stderr, "%s: error on input\n", progname);
+  if (!(puzzle = getpuzzle(c, progname)))
     return -1;
-  }
-  if (fin && fin != stdin)
-    fclose(fin);
 
-  diff = nonogram_verifypuzzle(&puzzle);
+  diff = nonogram_verifypuzzle(puzzle);
   if (c->verbose && diff)
     fprintf(stderr, "%s-heaviness: %d\n",
             diff > 0 ? "Row" : "Column", diff > 0 ? diff : -diff);
-  printf("%d\n", diff);
+  fprintf(c->out, "%d\n", diff);
 
-  nonogram_freepuzzle(&puzzle);
   return 0;
 }
 
@@ -149,152 +226,98 @@ enum { TITLE, WIDTH, HEIGHT };
 
 int extractpart(context *c, const char *progname, int part)
 {
-  FILE *fin, *fout;
-  nonogram_puzzle puzzle;
+  FILE *fout;
+  nonogram_puzzle *puzzle;
   const char *t;
 
-  if (c->ifile) {
-    fin = fopen(c->ifile, "r");
-    if (!fin) {
-      fprintf(stderr, "%s: could not read\n", c->ifile);
-      return -1;
-    }
-  } else {
-    fin = stdin;
-  }
-
-  if (nonogram_fscanpuzzle(&puzzle, fin) < 0) {
-    if (c->ifile)
-      fclose(fin);
-    fprintf(stderr, "%s: error on input\n", progname);
+  if (!(puzzle = getpuzzle(c, progname)))
     return -1;
-  }
-  if (fin && fin != stdin)
-    fclose(fin);
 
   switch (c->ofiletype) {
   case SINGLE:
     fout = fopen(c->ofile, "w");
     if (!fout) {
       fprintf(stderr, "%s: can't write file\n", c->ofile);
-      nonogram_freepuzzle(&puzzle);
       return -1;
     }
     break;
   case STDSTREAM:
-    fout = stdout;
+    fout = c->out;
     break;
   case MULTIPLE:
+  case ARCHIVE:
     fprintf(stderr, "%s: inappropriate output (use -o, -os or +o)\n",
             progname);
-    nonogram_freepuzzle(&puzzle);
     return -1;
   default:
-    nonogram_freepuzzle(&puzzle);
     return 0;
   }
 
   switch (part) {
   case TITLE:
-    t = nonogram_puzzletitle(&puzzle);
+    t = nonogram_puzzletitle(puzzle);
     if (t) fprintf(fout, "%s", t);
     break;
   case WIDTH:
-    fprintf(fout, "%zu", puzzle.width);
+    fprintf(fout, "%zu", puzzle->width);
     break;
   case HEIGHT:
-    fprintf(fout, "%zu", puzzle.height);
+    fprintf(fout, "%zu", puzzle->height);
     break;
   }
 
-  if (fout && fout != stdout)
+  if (fout && fout != c->out)
     fclose(fout);
-  nonogram_freepuzzle(&puzzle);
   return 0;
 }
 
 int extractnote(context *c, const char *progname, const char *name)
 {
-  FILE *fin, *fout;
-  nonogram_puzzle puzzle;
+  FILE *fout;
+  nonogram_puzzle *puzzle;
   const char *t;
 
-  if (c->ifile) {
-    fin = fopen(c->ifile, "r");
-    if (!fin) {
-      fprintf(stderr, "%s: could not read\n", c->ifile);
-      return -1;
-    }
-  } else {
-    fin = stdin;
-  }
-
-  if (nonogram_fscanpuzzle(&puzzle, fin) < 0) {
-    if (c->ifile)
-      fclose(fin);
-    fprintf(stderr, "%s: error on input\n", progname);
+  if (!(puzzle = getpuzzle(c, progname)))
     return -1;
-  }
-  if (fin && fin != stdin)
-    fclose(fin);
 
-  t = nonogram_getnote(&puzzle, name);
+  t = nonogram_getnote(puzzle, name);
   if (t) {
     switch (c->ofiletype) {
     case SINGLE:
       fout = fopen(c->ofile, "w");
       if (!fout) {
         fprintf(stderr, "%s: can't write file\n", c->ofile);
-        nonogram_freepuzzle(&puzzle);
         return -1;
       }
       break;
     case STDSTREAM:
-      fout = stdout;
+      fout = c->out;
       break;
     case MULTIPLE:
+    case ARCHIVE:
       fprintf(stderr, "%s: inappropriate output (use -o, -os or +o)\n",
               progname);
-      nonogram_freepuzzle(&puzzle);
       return -1;
     default:
-      nonogram_freepuzzle(&puzzle);
       return 0;
     }
 
     fprintf(fout, "%s", t);
 
-    if (fout && fout != stdout)
+    if (fout && fout != c->out)
       fclose(fout);
   }
-  nonogram_freepuzzle(&puzzle);
   return t ? 0 : -1;
 }
 
 int deletenote(context *c, const char *progname, const char *name)
 {
-  FILE *fin, *fout;
+  FILE *fout;
   nonogram_puzzle puzzle;
   int t;
 
-  if (c->ifile) {
-    fin = fopen(c->ifile, "r");
-    if (!fin) {
-      fprintf(stderr, "%s: could not read\n", c->ifile);
-      return -1;
-    }
-  } else {
-    fin = stdin;
-  }
-
-  if (nonogram_fscanpuzzle(&puzzle, fin) < 0) {
-    if (c->ifile)
-      fclose(fin);
-    fprintf(stderr, "%s: error on input\n", progname);
+  if (takepuzzle(c, progname, &puzzle) < 0)
     return -1;
-  }
-  if (fin && fin != stdin)
-    fclose(fin);
 
   t = nonogram_unsetnote(&puzzle, name);
   if (t == 0) {
@@ -308,9 +331,10 @@ int deletenote(context *c, const char *progname, const char *name)
       }
       break;
     case STDSTREAM:
-      fout = stdout;
+      fout = c->out;
       break;
     case MULTIPLE:
+    case ARCHIVE:
       fprintf(stderr, "%s: inappropriate output (use -o, -os or +o)\n",
               progname);
       nonogram_freepuzzle(&puzzle);
@@ -322,7 +346,7 @@ int deletenote(context *c, const char *progname, const char *name)
 
     nonogram_fprintpuzzle(&puzzle, fout);
 
-    if (fout && fout != stdout)
+    if (fout && fout != c->out)
       fclose(fout);
   }
   nonogram_freepuzzle(&puzzle);
@@ -332,28 +356,12 @@ int deletenote(context *c, const char *progname, const char *name)
 int replacenote(context *c, const char *progname,
                 const char *name, const char *value, int safe)
 {
-  FILE *fin, *fout;
+  FILE *fout;
   nonogram_puzzle puzzle;
   int t;
 
-  if (c->ifile) {
-    fin = fopen(c->ifile, "r");
-    if (!fin) {
-      fprintf(stderr, "%s: could not read\n", c->ifile);
-      return -1;
-    }
-  } else {
-    fin = stdin;
-  }
-
-  if (nonogram_fscanpuzzle(&puzzle, fin) < 0) {
-    if (c->ifile)
-      fclose(fin);
-    fprintf(stderr, "%s: error on input\n", progname);
+  if (takepuzzle(c, progname, &puzzle) < 0)
     return -1;
-  }
-  if (fin && fin != stdin)
-    fclose(fin);
 
   if (safe && nonogram_getnote(&puzzle, name)) {
     t = c->verbose ? -1 : 0;
@@ -375,9 +383,10 @@ int replacenote(context *c, const char *progname,
       }
       break;
     case STDSTREAM:
-      fout = stdout;
+      fout = c->out;
       break;
     case MULTIPLE:
+    case ARCHIVE:
       fprintf(stderr, "%s: inappropriate output (use -o, -os or +o)\n",
               progname);
       nonogram_freepuzzle(&puzzle);
@@ -389,7 +398,7 @@ int replacenote(context *c, const char *progname,
 
     nonogram_fprintpuzzle(&puzzle, fout);
 
-    if (fout && fout != stdout)
+    if (fout && fout != c->out)
       fclose(fout);
   }
   nonogram_freepuzzle(&puzzle);
@@ -398,253 +407,1825 @@ int replacenote(context *c, const char *progname,
 
 int judge(context *c, const char *progname)
 {
-  FILE *fin;
-  nonogram_puzzle puzzle;
+  nonogram_puzzle *puzzle;
   float rating;
 
-  if (c->ifile) {
-    fin = fopen(c->ifile, "r");
-    if (!fin) {
-      fprintf(stderr, "%s: could not read\n", c->ifile);
-      return -1;
-    }
-  } else {
-    fin = stdin;
-  }
-
-  if (nonogram_fscanpuzzle(&puzzle, fin) < 0) {
-    if (c->ifile)
-      fclose(fin);
-    fprintf(stderr, "%s: error on input\n", progname);
+  if (!(puzzle = getpuzzle(c, progname)))
     return -1;
-  }
-  if (fin && fin != stdin)
-    fclose(fin);
 
-  rating = nonogram_judgepuzzle(&puzzle);
+  rating = nonogram_judgepuzzle(puzzle);
   if (c->verbose)
     fprintf(stderr, "Puzzle difficulty: %.0f (%s)\n", rating,
             c->ifile ? c->ifile : "stdin");
-  printf("%.0f\n", rating);
+  fprintf(c->out, "%.0f\n", rating);
 
-  nonogram_freepuzzle(&puzzle);
   return 0;
 }
 
-int encodepuzzle(context *c, const char *progname)
+static char *encodekey(const nonogram_puzzle *puzzle, size_t *len)
 {
-  FILE *fin;
-  char *ptr, *buf = NULL;
+  char *ptr, *buf;
   size_t buflen = 0;
-  nonogram_puzzle puzzle;
 
-  if (c->ifile) {
-    fin = fopen(c->ifile, "r");
-    if (!fin) {
-      fprintf(stderr, "%s: could not read\n", c->ifile);
-      return -1;
-    }
-  } else {
-    fin = stdin;
+  if (nonocache_encodepuzzle(NULL, &buflen, puzzle) != 0 ||
+      (ptr = buf = malloc(buflen + 1)) == NULL)
+    return NULL;
+  if (nonocache_encodepuzzle(&ptr, &buflen, puzzle) != 0) {
+    free(buf);
+    return NULL;
   }
+  *ptr = '\0';
+  *len = ptr - buf;
+  return buf;
+}
 
-  if (nonogram_fscanpuzzle(&puzzle, fin) < 0) {
-    if (c->ifile)
-      fclose(fin);
-    fprintf(stderr, "%s: error on input\n", progname);
-    return -1;
-  }
+int encodepuzzle(context *c, const char *progname)
+{
+  nonogram_puzzle *puzzle;
 
-  if (fin && fin != stdin)
-    fclose(fin);
+  if (!(puzzle = getpuzzle(c, progname)))
+    return -1;
 
-  int rc = -1;
-  if (nonocache_encodepuzzle(NULL, &buflen, &puzzle) == 0 &&
-      (ptr = buf = malloc(buflen + 1)) != NULL &&
-      nonocache_encodepuzzle(&ptr, &buflen, &puzzle) == 0) {
-    *ptr = '\0';
-    printf("%s\n", buf);
-    rc = 0;
+  if (encoding_print(c->out, puzzle) < 0) {
+    fprintf(stderr, "%s: could not encode puzzle\n", progname);
+    return -1;
   }
-  free(buf);
+  fputc('\n', c->out);
 
-  nonogram_freepuzzle(&puzzle);
-  return rc;
+  return 0;
 }
 
-int solve(context *c, const char *progname)
+const char *algoname(int algo)
 {
-  FILE *fin;
-  struct h_tag handle;
-  time_t nowtime;
-  int tries, diff;
+  return
+    algo == nonogram_AFASTODDONES ? "fastodd" :
+    algo == nonogram_AFASTOLSAK ? "fastolsak" :
+    algo == nonogram_AFASTODDONESCOMPLETE ? "fastoddcomplete" :
+    algo == nonogram_AFASTOLSAKCOMPLETE ? "fastolsakcomplete" :
+    algo == nonogram_AOLSAK ? "olsak" :
+    algo == nonogram_AHYBRID ? "hybrid" :
+    algo == nonogram_AFAST ? "fast" :
+    algo == nonogram_AFCOMP ? "fcomp" :
+    algo == nonogram_AFFCOMP ? "ffcomp" :
+    algo == nonogram_ANULL ? "null" :
+    algo == nonogram_ACOMPLETE ? "complete" : "unknown";
+}
 
-  time(&nowtime);
+#ifndef NOTHREADS
+/* the line solvers entered by -Arace */
+static const int race_algos[] = {
+  nonogram_AFAST, nonogram_AOLSAK, nonogram_AFFCOMP,
+  nonogram_AFASTOLSAKCOMPLETE
+};
+#define RACERS (sizeof race_algos / sizeof race_algos[0])
+
+/* the most solutions each racer holds; one that fills its list waits
+   for the race to be decided, and if every racer still running fills
+   its list, the first to do so wins, and passes the rest on as
+   found */
+#define RACE_KEEP 1024
+
+struct race;
+
+struct racer {
+  struct race *race;
+  const nonogram_puzzle *puzzle;
+  nonogram_solver solver;
+  nonogram_cell *grid;
+  struct gridlist sols;
+  size_t nsols;
+  struct stats stats;
+  pthread_t thread;
+  int algo, limit, quantum;
+  double deadline;
+  unsigned long long maxsteps;
+  unsigned stop : 1, lost : 1, failed : 1, keep : 1, expired : 1,
+    streaming : 1, counting : 1;
+};
+
+struct race {
+  pthread_mutex_t lock;
+  pthread_cond_t decided;
+  struct h_tag *h;
+  struct racer *winner, *first;
+  unsigned live, paused;
+  struct racer racers[RACERS];
+};
+
+/* With the lock held, give the race to the first racer to fill its
+   list, if all those still running have, and wake the waiting
+   racers. */
+static void decide(struct race *race)
+{
+  if (!race->winner && race->paused > 0 && race->paused == race->live)
+    race->winner = race->first;
+  pthread_cond_broadcast(&race->decided);
+}
 
-  nonogram_initsolver(&handle.solver);
+/* Pass a solution to print_it() from the winning racer's thread. */
+static void passsolution(struct racer *r, const nonogram_cell *grid)
+{
+  struct h_tag *h = r->race->h;
 
-  handle.logfp = NULL;
-  if (c->logfile) {
-    handle.logfp = fopen(c->logfile, c->logappend ? "a" : "w");
-    if (!handle.logfp) {
-      fprintf(stderr, "%s: could not open\n", c->logfile);
-      return -1;
-    }
-  }
+  memcpy(h->grid, grid, r->sols.cells);
+  print_it(h);
+  if (h->stop)
+    r->stop = true;
+}
 
-  if (handle.logfp) {
-    fprintf(handle.logfp, "log started at %s\n", ctime(&nowtime));
-    fflush(handle.logfp);
+/* Keep a copy of each solution, as only the winner's are output.  A
+   racer that fills its list waits until another finishes, or until
+   all still running have filled theirs, when the first to do so takes
+   the race, and passes on its solutions from then on, instead of
+   keeping them all. */
+static void recordsolution(void *vr)
+{
+  struct racer *r = vr;
+  struct race *race = r->race;
+  size_t i;
+
+  /* A quantum may run on past the limit. */
+  if (r->stop)
+    return;
+  r->nsols++;
+  if (r->streaming) {
+    passsolution(r, r->grid);
+    return;
   }
-
-  handle.c = c;
-  if (c->ifile) {
-    fin = fopen(c->ifile, "r");
-    if (!fin) {
-      fprintf(stderr, "%s: could not read\n", c->ifile);
-      if (handle.logfp)
-        fclose(handle.logfp);
-      return -1;
+  if (r->keep && r->sols.n == RACE_KEEP) {
+    pthread_mutex_lock(&race->lock);
+    if (!race->winner) {
+      if (race->paused++ == 0)
+        race->first = r;
+      decide(race);
+      while (!race->winner)
+        pthread_cond_wait(&race->decided, &race->lock);
+      race->paused--;
     }
-  } else {
-    fin = stdin;
+    r->streaming = race->winner == r;
+    pthread_mutex_unlock(&race->lock);
+    if (!r->streaming) {
+      r->lost = r->stop = true;
+      return;
+    }
+    for (i = 0; i < r->sols.n && !r->stop; i++)
+      passsolution(r, r->sols.grids + i * r->sols.cells);
+    r->sols.n = 0;
+    if (!r->stop)
+      passsolution(r, r->grid);
+    return;
   }
-
-  if (nonogram_fscanpuzzle(&handle.puzzle, fin) < 0) {
-    if (c->ifile)
-      fclose(fin);
-    fprintf(stderr, "%s: error on input\n", progname);
-    if (handle.logfp)
-      fclose(handle.logfp);
-    return -1;
+  if (r->keep && gridlist_add(&r->sols, r->grid) < 0) {
+    r->failed = r->stop = true;
+    return;
   }
+  if (r->limit > 0 && r->nsols >= (size_t) r->limit)
+    r->stop = true;
+}
 
-  if (fin && fin != stdin)
-    fclose(fin);
+static const struct nonogram_client race_client = {
+  &recordsolution
+};
 
-  /* verify puzzle integrity */
-  diff = nonogram_verifypuzzle(&handle.puzzle);
-  if (diff && c->verbose)
-    fprintf(stderr, "Warning: puzzle (%s) has imbalance: %d\n",
-            c->ifile ? c->ifile : "stdin", diff);
+/* Count what -stats reports for each racer, so that the winner's
+   counts can be reported. */
+static void race_drawarea(void *vr, const struct nonogram_rect *a)
+{
+  struct racer *r = vr;
 
-  handle.fp = NULL;
-  if (c->ofiletype == SINGLE) {
-    handle.fp = fopen(c->ofile, "w");
-    if (!handle.fp) {
-      fprintf(stderr, "%s: can't write file\n", c->ofile);
-      nonogram_freepuzzle(&handle.puzzle);
-      if (handle.logfp)
-        fclose(handle.logfp);
-      return -1;
-    }
-  }
+  r->stats.cells += (a->max.x - a->min.x) * (a->max.y - a->min.y);
+}
 
-  if (!diff || c->visual) {
-    handle.grid = nonogram_makegrid(nonogram_puzzlewidth(&handle.puzzle),
-                                    nonogram_puzzleheight(&handle.puzzle));
-    nonogram_cleargrid(handle.grid, nonogram_puzzlewidth(&handle.puzzle),
-                       nonogram_puzzleheight(&handle.puzzle));
-  }
+static void race_rowfocus(void *vr, size_t row, int s)
+{
+  struct racer *r = vr;
 
-#ifndef NOVISUAL
-  if (c->visual) {
-    clear_screen();
-#ifdef BBCGFX
-    draw_grid(nonogram_puzzlewidth(&handle.puzzle),
-              nonogram_puzzleheight(&handle.puzzle));
-#endif
-  }
-#endif
+  (void) row;
+  if (s)
+    r->stats.rowfocus++;
+}
 
-  handle.solno = 0;
-  if (!diff || c->visual) {
-    nonogram_setalgo(&handle.solver, c->algo);
-    nonogram_setlog(&handle.solver, handle.logfp, 0, c->loglevel);
-    nonogram_setclient(&handle.solver, &our_client, &handle);
-  }
+static void race_colfocus(void *vr, size_t col, int s)
+{
+  struct racer *r = vr;
 
-#ifndef NOVISUAL
-  if (c->visual)
-    nonogram_setdisplay(&handle.solver, &our_display, &handle);
-#endif
+  (void) col;
+  if (s)
+    r->stats.colfocus++;
+}
 
-  /* now load the puzzle after configuration */
-  nonogram_load(&handle.solver, &handle.puzzle, handle.grid,
-                nonogram_puzzlewidth(&handle.puzzle) *
-                nonogram_puzzleheight(&handle.puzzle));
+static void race_mark(void *vr, size_t f, size_t t)
+{
+  (void) vr;
+  (void) f;
+  (void) t;
+}
 
-#ifndef NOVISUAL
-  if (c->visual) {
-    (*our_display.rowmark)(&handle, 0,
-                           nonogram_puzzleheight(&handle.puzzle) - 1);
-    (*our_display.colmark)(&handle, 0,
-                           nonogram_puzzlewidth(&handle.puzzle) - 1);
-  }
-#endif
+static const struct nonogram_display race_display = {
+  &race_drawarea,
+  &race_rowfocus,
+  &race_colfocus,
+  &race_mark,
+  &race_mark
+};
 
-  if (!diff || c->visual) {
-    handle.stop = false;
-    while (!handle.stop &&
-           nonogram_runsolver_n(&handle.solver,
-                                (tries = 1, &tries)) != nonogram_FINISHED)
-      ;
+static void *runracer(void *vr)
+{
+  struct racer *r = vr;
+  struct race *race = r->race;
+  struct quantum q;
+
+  quantum_init(&q, r->quantum);
+  if (r->maxsteps > 0)
+    quantum_limit(&q, r->maxsteps);
+  r->grid = nonogram_makegrid(nonogram_puzzlewidth(r->puzzle),
+                              nonogram_puzzleheight(r->puzzle));
+  if (!r->grid) {
+    r->failed = true;
+    pthread_mutex_lock(&race->lock);
+    race->live--;
+    decide(race);
+    pthread_mutex_unlock(&race->lock);
+    return NULL;
   }
-
-#ifndef NOVISUAL
-  if (c->visual)
-    move_to(0, nonogram_puzzleheight(&handle.puzzle) + 6);
-#endif
-
-  if (!diff || c->visual) {
-    nonogram_termsolver(&handle.solver);
-    nonogram_freegrid(handle.grid);
+  nonogram_initsolver(&r->solver);
+  nonogram_cleargrid(r->grid, nonogram_puzzlewidth(r->puzzle),
+                     nonogram_puzzleheight(r->puzzle));
+  nonogram_setalgo(&r->solver, r->algo);
+  nonogram_setclient(&r->solver, &race_client, r);
+  if (r->counting)
+    nonogram_setdisplay(&r->solver, &race_display, r);
+  nonogram_load(&r->solver, r->puzzle, r->grid,
+                nonogram_puzzlewidth(r->puzzle) *
+                nonogram_puzzleheight(r->puzzle));
+
+  while (!r->stop &&
+         quantum_run(&q, &r->solver, &r->stats.steps) != nonogram_FINISHED) {
+    if (quantum_spent(&q) || (r->deadline > 0 && monotime() >= r->deadline))
+      r->expired = r->lost = r->stop = true;
+    pthread_mutex_lock(&race->lock);
+    if (race->winner && race->winner != r)
+      r->lost = r->stop = true;
+    pthread_mutex_unlock(&race->lock);
   }
 
-  nonogram_freepuzzle(&handle.puzzle);
-  if (handle.fp)
-    fclose(handle.fp);
-
-  if (handle.logfp) {
-    time(&nowtime);
-    fprintf(handle.logfp, "log ended at %s\n", ctime(&nowtime));
-    fclose(handle.logfp);
-  }
+  pthread_mutex_lock(&race->lock);
+  if (!race->winner && !r->lost && !r->failed)
+    race->winner = r;
+  race->live--;
+  decide(race);
+  pthread_mutex_unlock(&race->lock);
 
-  if (c->countonerr)
-    fprintf(stderr, "%d\n", handle.solno);
-  if (c->countonout)
-    fprintf(stdout, "%d\n", handle.solno);
-  return 0;
+  nonogram_termsolver(&r->solver);
+  nonogram_freegrid(r->grid);
+  return NULL;
 }
 
-int print_usage(FILE *fp, const char *progname)
+/* Solve h->puzzle with several line solvers at once, and pass the
+   solutions of whichever finishes first to print_it(). */
+static int runrace(struct h_tag *h)
 {
-  int count = 0;
-
-  count += fprintf(fp, "usage: %s [-o output] [-on out%%dput] [-os] [+o]\n",
-                   progname);
-  count += fprintf(fp, "\t"
-#ifndef NOVISUAL
-                   "[-/+v] "
-#endif
-                   "[-/+table] [-(n)log logfile] [+(n)log] [-ll level]\n");
-  count += fprintf(fp, "\t[-html] [-dot str] [-solid str]"
-                   " [-blank str] [+dot/solid/blank]\n");
-  count += fprintf(fp, "\t[+html] [-dot str] [-solid str]"
+  struct race race;
+  size_t i, n, cells;
+  double deadline = h->c->timeout > 0 ?
+    monotime() + h->c->timeout / 1000.0 : 0.0;
+
+  cells = nonogram_puzzlewidth(&h->puzzle) *
+    nonogram_puzzleheight(&h->puzzle);
+  h->grid = nonogram_makegrid(nonogram_puzzlewidth(&h->puzzle),
+                              nonogram_puzzleheight(&h->puzzle));
+  if (!h->grid)
+    return -1;
+  h->stop = false;
+
+  pthread_mutex_init(&race.lock, NULL);
+  pthread_cond_init(&race.decided, NULL);
+  race.h = h;
+  race.winner = race.first = NULL;
+  /* All are counted from the start, so that none wins by filling its
+     list before the others have begun. */
+  race.live = RACERS;
+  race.paused = 0;
+  for (n = 0; n < RACERS; n++) {
+    struct racer *r = &race.racers[n];
+    r->race = &race;
+    r->puzzle = &h->puzzle;
+    gridlist_init(&r->sols, cells, RACE_KEEP);
+    r->nsols = 0;
+    clearstats(&r->stats);
+    r->algo = race_algos[n];
+    r->limit = h->c->limit;
+    r->quantum = h->c->quantum;
+    r->deadline = deadline;
+    r->maxsteps = h->c->maxsteps;
+    r->stop = r->lost = r->failed = r->expired = r->streaming = false;
+    r->keep = !h->c->countonly;
+    r->counting = h->c->statsfile != NULL;
+    if (pthread_create(&r->thread, NULL, &runracer, r)) {
+      gridlist_term(&r->sols);
+      pthread_mutex_lock(&race.lock);
+      race.live -= RACERS - n;
+      decide(&race);
+      pthread_mutex_unlock(&race.lock);
+      break;
+    }
+  }
+  for (i = 0; i < n; i++)
+    pthread_join(race.racers[i].thread, NULL);
+  pthread_cond_destroy(&race.decided);
+  pthread_mutex_destroy(&race.lock);
+
+  if (race.winner) {
+    if (h->logfp)
+      fprintf(h->logfp, "race won by %s\n", algoname(race.winner->algo));
+    h->stats.steps = race.winner->stats.steps;
+    h->stats.rowfocus = race.winner->stats.rowfocus;
+    h->stats.colfocus = race.winner->stats.colfocus;
+    h->stats.cells = race.winner->stats.cells;
+
+    if (h->c->countonly) {
+      h->solno = race.winner->nsols;
+      h->stop = race.winner->stop;
+    } else if (race.winner->streaming) {
+      /* Its solutions have been passed on already, but it may not have
+         finished. */
+      if (race.winner->expired)
+        h->expired = true;
+    } else {
+      for (i = 0; i < race.winner->sols.n; i++) {
+        memcpy(h->grid, race.winner->sols.grids + i * cells, cells);
+        print_it(h);
+      }
+    }
+  }
+
+  for (i = 0; i < n; i++) {
+    if (!race.winner && race.racers[i].expired)
+      h->expired = true;
+    gridlist_term(&race.racers[i].sols);
+  }
+  nonogram_freegrid(h->grid);
+  return race.winner || h->expired ? 0 : -1;
+}
+#endif
+
+static const char *solvername(const context *c)
+{
+  return c->race ? "race" : algoname(c->algo);
+}
+
+/* Record how many solutions have been written, after making sure they
+   have been. */
+static void savecheckpoint(struct h_tag *h, int done)
+{
+  struct checkpoint cp;
+
+  if (h->fp)
+    fflush(h->fp);
+  cp.key = h->ckkey;
+  cp.keylen = h->ckkeylen;
+  cp.solver = solvername(h->c);
+  cp.solutions = h->solno > h->skip ? h->solno : h->skip;
+  cp.steps = h->stats.steps;
+  cp.output = h->fp && h->c->ofiletype == SINGLE ? ftell(h->fp) : -1;
+  cp.done = done;
+  if (checkpoint_write(h->c->checkpointfile, &cp) < 0)
+    fprintf(stderr, "%s: could not write checkpoint\n",
+            h->c->checkpointfile);
+  h->cknext = monotime() + CHECKPOINT_PERIOD;
+}
+
+/* Get the puzzle's key for -checkpoint, and with -resume, how many
+   solutions an earlier run has written, and how much of the output
+   file holds them.  Returns 1 if that run finished, leaving the count
+   in h->solno. */
+static int readcheckpoint(struct h_tag *h, long *output)
+{
+  context *c = h->c;
+  struct checkpoint cp;
+  char solver[CHECKPOINT_MAXNAME + 1];
+  int got;
+
+  h->ckkey = NULL;
+  h->skip = 0;
+  *output = -1;
+  if (!c->checkpointfile)
+    return 0;
+  h->ckkey = encodekey(&h->puzzle, &h->ckkeylen);
+  if (!h->ckkey) {
+    fprintf(stderr, "%s: could not encode puzzle\n", c->checkpointfile);
+    return -1;
+  }
+  h->cknext = monotime() + CHECKPOINT_PERIOD;
+  if (!c->resume)
+    return 0;
+
+  /* Which racer wins, and so the order of the solutions, can differ
+     from run to run, so those already written can't be skipped. */
+  if (c->race) {
+    fprintf(stderr, "%s: can't resume with -Arace\n", c->checkpointfile);
+    return -1;
+  }
+
+  /* With no checkpoint yet, start from the beginning. */
+  got = checkpoint_read(c->checkpointfile, &cp, solver);
+  if (got > 0)
+    return 0;
+  if (got < 0) {
+    fprintf(stderr, "%s: could not read checkpoint\n", c->checkpointfile);
+    return -1;
+  }
+  if (cp.keylen != h->ckkeylen || memcmp(cp.key, h->ckkey, cp.keylen) ||
+      strcmp(solver, solvername(c))) {
+    fprintf(stderr, "%s: checkpoint is of another puzzle or solver\n",
+            c->checkpointfile);
+    free(cp.key);
+    return -1;
+  }
+  free(cp.key);
+  h->skip = cp.solutions;
+  *output = cp.output;
+  if (cp.done) {
+    h->solno = cp.solutions;
+    return 1;
+  }
+  return 0;
+}
+
+/* Search for solutions to h->puzzle, passing them to the client. */
+static int searchpuzzle(struct h_tag *h, const char *name)
+{
+  context *c = h->c;
+  struct quantum q;
+  double began, deadline;
+
+  h->solno = 0;
+  h->expired = false;
+#ifndef NOTHREADS
+  if (c->race && !c->visual) {
+    began = monotime();
+    if (runrace(h) < 0) {
+      fprintf(stderr, "%s: no line solver finished\n", name);
+      return -1;
+    }
+    if (h->expired && c->verbose)
+      fprintf(stderr, "%s: no line solver finished in time\n", name);
+    if (h->expired && h->ckkey)
+      savecheckpoint(h, false);
+    h->stats.solve = monotime() - began - h->stats.output;
+    tracephase(h, "race", began, began + h->stats.solve);
+    return 0;
+  }
+#endif
+
+  began = monotime();
+  nonogram_initsolver(&h->solver);
+  h->grid = nonogram_makegrid(nonogram_puzzlewidth(&h->puzzle),
+                              nonogram_puzzleheight(&h->puzzle));
+  nonogram_cleargrid(h->grid, nonogram_puzzlewidth(&h->puzzle),
+                     nonogram_puzzleheight(&h->puzzle));
+
+#ifndef NOVISUAL
+  if (c->visual)
+    begin_display(h);
+#endif
+
+  nonogram_setalgo(&h->solver, c->algo);
+  nonogram_setlog(&h->solver, h->logfp, 0, c->loglevel);
+  nonogram_setclient(&h->solver,
+                     !c->countonly ? &our_client :
+                     c->limit > 0 ? &our_limited_counter : &our_counter, h);
+
+  if (c->statsfile || c->tracefile)
+    nonogram_setdisplay(&h->solver, &monitor_display, h);
+#ifndef NOVISUAL
+  else if (c->visual)
+    nonogram_setdisplay(&h->solver, &our_display, h);
+#endif
+
+  /* now load the puzzle after configuration */
+  nonogram_load(&h->solver, &h->puzzle, h->grid,
+                nonogram_puzzlewidth(&h->puzzle) *
+                nonogram_puzzleheight(&h->puzzle));
+  h->stats.load = monotime() - began;
+  tracephase(h, "load", began, began + h->stats.load);
+
+#ifndef NOVISUAL
+  if (c->visual) {
+    (*our_display.rowmark)(h, 0, nonogram_puzzleheight(&h->puzzle) - 1);
+    (*our_display.colmark)(h, 0, nonogram_puzzlewidth(&h->puzzle) - 1);
+  }
+#endif
+
+  /* The visual display is kept to one step per call. */
+  quantum_init(&q, c->visual ? 1 : c->quantum);
+  if (c->maxsteps > 0)
+    quantum_limit(&q, c->maxsteps);
+  h->stop = false;
+  began = monotime();
+  deadline = began + c->timeout / 1000.0;
+  while (!h->stop &&
+         quantum_run(&q, &h->solver, &h->stats.steps) != nonogram_FINISHED) {
+    if (h->ckkey && monotime() >= h->cknext)
+      savecheckpoint(h, false);
+    if (quantum_spent(&q) || (c->timeout > 0 && monotime() >= deadline)) {
+      h->expired = true;
+      break;
+    }
+  }
+  h->stats.solve = monotime() - began - h->stats.output;
+  tracephase(h, "solve", began, monotime());
+
+  if (h->expired) {
+    if (c->verbose)
+      fprintf(stderr, "%s: search stopped after %llu solution%s\n", name,
+              h->solno, h->solno == 1 ? "" : "s");
+    if (h->logfp)
+      fprintf(h->logfp, "search stopped after %llu solutions\n", h->solno);
+    /* Record progress before the partial grid is written. */
+    if (h->ckkey)
+      savecheckpoint(h, false);
+    print_partial(h);
+  }
+
+#ifndef NOVISUAL
+  if (c->visual)
+    end_display(h);
+#endif
+
+  nonogram_termsolver(&h->solver);
+  nonogram_freegrid(h->grid);
+  return 0;
+}
+
+/* Pass on the cached solutions if they cover what has been asked
+   for. */
+static int replay(struct h_tag *h, const struct cacheentry *e)
+{
+  context *c = h->c;
+  size_t w = nonogram_puzzlewidth(&h->puzzle);
+  size_t ht = nonogram_puzzleheight(&h->puzzle);
+  unsigned long long want, i;
+
+  if (e->width != w || e->height != ht)
+    return false;
+  want = c->limit > 0 && (unsigned) c->limit < e->count ?
+    (unsigned long long) c->limit : e->count;
+  if (!e->complete && (c->limit <= 0 || e->count < (unsigned) c->limit))
+    return false;
+
+  if (c->countonly) {
+    h->solno = want;
+    return true;
+  }
+  if (e->stored < want)
+    return false;
+
+  h->grid = nonogram_makegrid(w, ht);
+  if (!h->grid)
+    return false;
+  h->solno = 0;
+  h->stop = false;
+  for (i = 0; i < want && !h->stop; i++) {
+    memcpy(h->grid, e->grids + i * w * ht, w * ht * sizeof *h->grid);
+    print_it(h);
+  }
+  nonogram_freegrid(h->grid);
+  return true;
+}
+
+/* Solve h->puzzle from the cache, or solve it and add it to the
+   cache. */
+/* Solvers find solutions in different orders, so the first few kept
+   for -s depend on the solver as well as the puzzle. */
+static char *cachekey(const context *c, const nonogram_puzzle *puzzle,
+                      size_t *len)
+{
+  const char *solver = solvername(c);
+  size_t slen = strlen(solver);
+  char *key = encodekey(puzzle, len), *nkey;
+
+  if (!key)
+    return NULL;
+  nkey = realloc(key, *len + slen + 2);
+  if (!nkey) {
+    free(key);
+    return NULL;
+  }
+  nkey[*len] = '\n';
+  memcpy(nkey + *len + 1, solver, slen + 1);
+  *len += slen + 1;
+  return nkey;
+}
+
+static void cachepuzzle(struct h_tag *h, const char *name)
+{
+  context *c = h->c;
+  struct gridlist kept;
+  struct cacheentry e;
+  size_t keylen, cells;
+  char *key = cachekey(c, &h->puzzle, &keylen);
+
+  if (!key) {
+    searchpuzzle(h, name);
+    return;
+  }
+  if (cache_find(c->cache, key, keylen, &e) && replay(h, &e)) {
+    free(key);
+    return;
+  }
+
+  e.width = nonogram_puzzlewidth(&h->puzzle);
+  e.height = nonogram_puzzleheight(&h->puzzle);
+  cells = e.width * e.height;
+  gridlist_init(&kept, cells, CACHE_MAXGRIDBYTES / (cells ? cells : 1));
+  h->keep = &kept;
+  if (searchpuzzle(h, name) == 0) {
+    e.count = h->solno;
+    e.complete = !h->stop && !h->expired;
+    e.stored = kept.n;
+    e.grids = kept.grids;
+    if (cache_add(c->cache, key, keylen, &e) < 0)
+      fprintf(stderr, "%s: could not add to cache\n", c->cachefile);
+  }
+  h->keep = NULL;
+  gridlist_term(&kept);
+  free(key);
+}
+
+/* Solve the puzzle already in h->puzzle, passing solutions to h->fp.
+   The caller sets up the context, log and output, and frees the
+   puzzle afterwards. */
+static void runpuzzle(struct h_tag *h, const char *name)
+{
+  context *c = h->c;
+  int diff, binset;
+
+  /* verify puzzle integrity */
+  diff = nonogram_verifypuzzle(&h->puzzle);
+  if (diff && c->verbose)
+    fprintf(stderr, "Warning: puzzle (%s) has imbalance: %d\n", name, diff);
+
+  h->solno = 0;
+  h->expired = false;
+  h->keep = NULL;
+  if (diff && !c->visual)
+    return;
+
+  h->text = NULL;
+  h->textcap = 0;
+  binset = c->binary && !c->hash && h->fp &&
+    c->ofiletype != MULTIPLE && c->ofiletype != ARCHIVE;
+  h->hashset = c->hash && c->hashsort && h->fp &&
+    c->ofiletype != MULTIPLE && c->ofiletype != ARCHIVE;
+  h->hashes = NULL;
+  h->nhashes = h->hashcap = 0;
+  if (binset && !h->skip)
+    printbinheader(h->fp, nonogram_puzzlewidth(&h->puzzle),
+                   nonogram_puzzleheight(&h->puzzle));
+  if (c->cache && !c->visual && !h->skip)
+    cachepuzzle(h, name);
+  else
+    searchpuzzle(h, name);
+  if (binset)
+    printbintrailer(h->fp, h->solno);
+  if (h->hashset)
+    print_hashes(h);
+  free(h->text);
+}
+
+/* Solve a puzzle without writing anything, adding the solutions to
+   keep, for the library front end.  Returns 1 if -timeout or -maxsteps
+   cut the search short. */
+int keepsolutions(context *c, const nonogram_puzzle *puzzle,
+                  struct gridlist *keep, unsigned long long *count)
+{
+  struct h_tag handle;
+
+  handle.c = c;
+  handle.puzzle = *puzzle;
+  handle.fp = handle.logfp = NULL;
+  handle.keep = keep;
+  handle.hashset = false;
+  handle.text = NULL;
+  handle.textcap = 0;
+  handle.trace.fp = NULL;
+  handle.ckkey = NULL;
+  handle.skip = 0;
+  clearstats(&handle.stats);
+  if (searchpuzzle(&handle, "puzzle") < 0)
+    return -1;
+  *count = handle.solno;
+  return handle.expired;
+}
+
+int opencache(context *c)
+{
+  if (!c->cachefile || c->cache)
+    return 0;
+  c->cache = cache_open(c->cachefile);
+  if (!c->cache) {
+    fprintf(stderr, "%s: could not open cache\n", c->cachefile);
+    return -1;
+  }
+  return 0;
+}
+
+/* room for ctime()'s text */
+#define LOGTIME_MAX 32
+
+/* Format a time for the log into buf, as ctime() would, but without
+   its shared buffer, as library calls may run at once. */
+static const char *logtime(time_t t, char *buf)
+{
+#ifdef NOTHREADS
+  (void) buf;
+  return ctime(&t);
+#else
+  return ctime_r(&t, buf);
+#endif
+}
+
+/* Open the -log/-nlog file, through a ring buffer if -logbuf is
+   set. */
+static FILE *openlog(const context *c)
+{
+  FILE *fp = fopen(c->logfile, c->logappend ? "a" : "w");
+
+  if (!fp) {
+    fprintf(stderr, "%s: could not open\n", c->logfile);
+    return NULL;
+  }
+  return asynclog_open(fp, c->logbuf);
+}
+
+/* Append a puzzle's -stats record. */
+static void writestats(const char *file, const char *name,
+                       const nonogram_puzzle *puzzle,
+                       unsigned long long solutions, const struct stats *s)
+{
+  FILE *fp = fopen(file, "a");
+
+  if (!fp) {
+    fprintf(stderr, "%s: could not open\n", file);
+    return;
+  }
+  printstats(fp, name, nonogram_puzzlewidth(puzzle),
+             nonogram_puzzleheight(puzzle), solutions, s);
+  fclose(fp);
+}
+
+int solve(context *c, const char *progname)
+{
+  struct h_tag handle;
+  time_t nowtime;
+  char when[LOGTIME_MAX];
+  double began, took;
+  long output;
+  int finished;
+
+  time(&nowtime);
+
+  if (opencache(c) < 0)
+    return -1;
+
+  handle.logfp = NULL;
+  if (c->logfile && !(handle.logfp = openlog(c)))
+    return -1;
+
+  if (handle.logfp) {
+    fprintf(handle.logfp, "log started at %s\n", logtime(nowtime, when));
+    fflush(handle.logfp);
+  }
+
+  handle.c = c;
+  clearstats(&handle.stats);
+  began = monotime();
+  if (takepuzzle(c, progname, &handle.puzzle) < 0) {
+    if (handle.logfp)
+      fclose(handle.logfp);
+    return -1;
+  }
+  handle.stats.parse = monotime() - began;
+
+  handle.trace.fp = NULL;
+  if ((finished = readcheckpoint(&handle, &output)) < 0 ||
+      (c->tracefile &&
+       begintrace(&handle, c->tracefile,
+                  c->ifile ? c->ifile : "stdin") < 0)) {
+    free(handle.ckkey);
+    nonogram_freepuzzle(&handle.puzzle);
+    if (handle.logfp)
+      fclose(handle.logfp);
+    return -1;
+  }
+
+  /* A resumed run adds to the solutions already written, dropping any
+     written since they were recorded. */
+  handle.fp = NULL;
+  if (c->countonly || finished) {
+    /* no solutions are written */
+  } else if (c->ofiletype == SINGLE) {
+    handle.fp = fopen(c->ofile, handle.skip ? "a" : "w");
+#ifndef NOFSYNC
+    if (handle.fp && handle.skip && output >= 0 &&
+        (ftruncate(fileno(handle.fp), output) != 0 ||
+         fseek(handle.fp, 0, SEEK_END) != 0)) {
+      fclose(handle.fp);
+      handle.fp = NULL;
+    }
+#endif
+  } else if (c->ofiletype == ARCHIVE) {
+    /* The index of an earlier run's solutions is lost, so the archive
+       is written again from the start. */
+    handle.skip = 0;
+    handle.fp = fopen(c->ofile, "wb");
+    if (handle.fp &&
+        archive_begin(&handle.arc, handle.fp,
+                      nonogram_puzzlewidth(&handle.puzzle),
+                      nonogram_puzzleheight(&handle.puzzle)) < 0) {
+      fclose(handle.fp);
+      handle.fp = NULL;
+    }
+  } else if (c->ofiletype == STDSTREAM) {
+    handle.fp = c->out;
+  }
+  if (!handle.fp && !c->countonly && !finished &&
+      (c->ofiletype == SINGLE || c->ofiletype == ARCHIVE)) {
+    fprintf(stderr, "%s: can't write file\n", c->ofile);
+    endtrace(&handle);
+    free(handle.ckkey);
+    nonogram_freepuzzle(&handle.puzzle);
+    if (handle.logfp)
+      fclose(handle.logfp);
+    return -1;
+  }
+
+  began = monotime();
+  handle.expired = false;
+  if (!finished) {
+    runpuzzle(&handle, c->ifile ? c->ifile : "stdin");
+    if (handle.ckkey && !handle.expired)
+      savecheckpoint(&handle, true);
+  }
+  took = monotime() - began;
+  if (handle.fp && c->ofiletype == ARCHIVE &&
+      archive_end(&handle.arc, handle.fp) < 0)
+    fprintf(stderr, "%s: can't write file\n", c->ofile);
+  endtrace(&handle);
+  free(handle.ckkey);
+  if (handle.expired)
+    c->expired = true;
+
+  if (c->statsfile)
+    writestats(c->statsfile, c->ifile ? c->ifile : "stdin",
+               &handle.puzzle, handle.solno, &handle.stats);
+  nonogram_freepuzzle(&handle.puzzle);
+  if (handle.fp && handle.fp != c->out)
+    fclose(handle.fp);
+
+  if (handle.logfp) {
+    time(&nowtime);
+    fprintf(handle.logfp, "log ended at %s\n", logtime(nowtime, when));
+    fclose(handle.logfp);
+  }
+
+  if (c->countonerr)
+    fprintf(stderr, "%llu\n", handle.solno);
+  if (c->countonout || c->countonly)
+    fprintf(c->out, "%llu\n", handle.solno);
+  if (c->countonly && c->verbose)
+    fprintf(stderr, "%llu solutions in %.3fs (%.0f per second)\n",
+            handle.solno, took, took > 0 ? handle.solno / took : 0.0);
+  return 0;
+}
+
+/* Convert binary solution sets back into the configured output. */
+int decode(context *c, const char *progname)
+{
+  FILE *fin;
+  context dc = *c;
+  struct h_tag handle;
+  size_t width, height;
+  unsigned long long count, n;
+  int got;
+
+  droppuzzle(c);
+  if (c->ifile) {
+    fin = fopen(c->ifile, "rb");
+    if (!fin) {
+      fprintf(stderr, "%s: could not read\n", c->ifile);
+      return -1;
+    }
+  } else {
+    fin = c->in;
+  }
+
+  dc.binary = false;
+  dc.limit = 0;
+  dc.visual = false;
+  dc.statsfile = NULL;
+  dc.tracefile = NULL;
+  handle.c = &dc;
+  handle.fp = NULL;
+  if (c->ofiletype == SINGLE) {
+    handle.fp = fopen(c->ofile, "w");
+    if (!handle.fp) {
+      fprintf(stderr, "%s: can't write file\n", c->ofile);
+      if (fin != c->in)
+        fclose(fin);
+      return -1;
+    }
+  } else if (c->ofiletype == STDSTREAM) {
+    handle.fp = c->out;
+  } else if (c->ofiletype == ARCHIVE) {
+    fprintf(stderr, "%s: inappropriate output (use -o, -os, -on or +o)\n",
+            progname);
+    if (fin != c->in)
+      fclose(fin);
+    return -1;
+  }
+  handle.keep = NULL;
+  handle.text = NULL;
+  handle.textcap = 0;
+  handle.solno = 0;
+  handle.skip = 0;
+  handle.stop = false;
+  handle.hashset = dc.hash && dc.hashsort && handle.fp &&
+    dc.ofiletype != MULTIPLE;
+  handle.hashes = NULL;
+  handle.nhashes = handle.hashcap = 0;
+
+  while ((got = scanbinheader(fin, &width, &height)) == 0) {
+    handle.puzzle.width = width;
+    handle.puzzle.height = height;
+    handle.grid = nonogram_makegrid(width, height);
+    if (!handle.grid) {
+      got = -1;
+      break;
+    }
+    n = 0;
+    while ((got = scanbingrid(fin, handle.grid, width, height, &count)) > 0) {
+      print_it(&handle);
+      n++;
+    }
+    nonogram_freegrid(handle.grid);
+    if (handle.hashset)
+      print_hashes(&handle);
+    if (got < 0)
+      break;
+    if (count != n && c->verbose)
+      fprintf(stderr, "%s: warning: set of %llu claims %llu\n",
+              progname, n, count);
+  }
+
+  free(handle.text);
+  if (handle.fp && handle.fp != c->out)
+    fclose(handle.fp);
+  if (fin != c->in)
+    fclose(fin);
+  if (got < 0) {
+    fprintf(stderr, "%s: bad binary solutions\n",
+            c->ifile ? c->ifile : "stdin");
+    return -1;
+  }
+  return 0;
+}
+
+/* Copy one solution out of an archive written by -oa. */
+int extract(context *c, const char *progname, unsigned long long k)
+{
+  FILE *fin, *fout;
+  unsigned long long count;
+  int rc;
+
+  droppuzzle(c);
+  switch (c->ofiletype) {
+  case SINGLE:
+    fout = fopen(c->ofile, "wb");
+    if (!fout) {
+      fprintf(stderr, "%s: can't write file\n", c->ofile);
+      return -1;
+    }
+    break;
+  case STDSTREAM:
+    fout = c->out;
+    break;
+  case MULTIPLE:
+  case ARCHIVE:
+    fprintf(stderr, "%s: inappropriate output (use -o, -os or +o)\n",
+            progname);
+    return -1;
+  default:
+    return 0;
+  }
+
+  if (c->ifile) {
+    fin = fopen(c->ifile, "rb");
+    if (!fin) {
+      fprintf(stderr, "%s: could not read\n", c->ifile);
+      if (fout != c->out)
+        fclose(fout);
+      return -1;
+    }
+  } else {
+    fin = c->in;
+  }
+
+  rc = archive_extract(fin, k, fout, &count);
+  if (rc > 0)
+    fprintf(stderr, "%s: no solution %llu of %llu\n",
+            c->ifile ? c->ifile : "stdin", k, count);
+  else if (rc < 0)
+    fprintf(stderr, "%s: bad archive\n", c->ifile ? c->ifile : "stdin");
+
+  if (fin != c->in)
+    fclose(fin);
+  if (fout != c->out)
+    fclose(fout);
+  return rc == 0 ? 0 : -1;
+}
+
+struct listitem {
+  char *name;
+  nonogram_puzzle puzzle;
+  unsigned loaded : 1, expired : 1;
+  unsigned long long solno;
+  struct stats stats;
+  size_t width, height;
+  int rc;
+};
+
+struct listrun {
+  context c;
+  const char *progname;
+  FILE *fout, *logfp, *statsfp;
+  struct pool pool;
+  int failed;
+};
+
+static void solvelistitem(void *vr, struct pool_job *j)
+{
+  struct listrun *r = vr;
+  struct listitem *it = j->data;
+  struct h_tag handle;
+  FILE *fin;
+  double began;
+
+  it->rc = -1;
+  if (it->loaded) {
+    handle.puzzle = it->puzzle;
+  } else {
+    began = monotime();
+    fin = fopen(it->name, "r");
+    if (!fin) {
+      fprintf(stderr, "%s: could not read\n", it->name);
+      return;
+    }
+    if (readpuzzle(&r->c, &handle.puzzle, fin) < 0) {
+      fclose(fin);
+      fprintf(stderr, "%s: error on input\n", it->name);
+      return;
+    }
+    fclose(fin);
+    it->stats.parse = monotime() - began;
+  }
+
+  handle.c = &r->c;
+  handle.fp = j->fp;
+  handle.logfp = r->logfp;
+  handle.stats = it->stats;
+  handle.trace.fp = NULL;
+  handle.ckkey = NULL;
+  handle.skip = 0;
+  runpuzzle(&handle, it->name);
+  it->width = nonogram_puzzlewidth(&handle.puzzle);
+  it->height = nonogram_puzzleheight(&handle.puzzle);
+  nonogram_freepuzzle(&handle.puzzle);
+
+  it->stats = handle.stats;
+  it->solno = handle.solno;
+  it->expired = handle.expired;
+  it->rc = 0;
+}
+
+static void emitlistitem(void *vr, struct pool_job *j)
+{
+  struct listrun *r = vr;
+  struct listitem *it = j->data;
+
+  if (j->failed) {
+    fprintf(stderr, "%s: %s: could not buffer output\n",
+            r->progname, it->name);
+    if (it->loaded)
+      nonogram_freepuzzle(&it->puzzle);
+    r->failed = true;
+  } else if (it->rc < 0) {
+    r->failed = true;
+  } else {
+    if (r->c.countonerr)
+      fprintf(stderr, "%llu\n", it->solno);
+    if (r->c.countonout || r->c.countonly)
+      fprintf(r->c.out, "%llu\n", it->solno);
+    if (it->expired)
+      r->c.expired = true;
+    if (r->statsfp)
+      printstats(r->statsfp, it->name, it->width, it->height,
+                 it->solno, &it->stats);
+  }
+  free(it->name);
+  free(it);
+}
+
+static struct listitem *newlistitem(const char *name, size_t len)
+{
+  struct listitem *it = malloc(sizeof *it);
+
+  if (!it)
+    return NULL;
+  it->name = malloc(len + 1);
+  if (!it->name) {
+    free(it);
+    return NULL;
+  }
+  memcpy(it->name, name, len);
+  it->name[len] = '\0';
+  it->loaded = false;
+  clearstats(&it->stats);
+  return it;
+}
+
+/* Open the output and log for a run of many puzzles, and start the
+   workers. */
+static int startrun(struct listrun *r, context *c, const char *progname,
+                    const char *sw)
+{
+  time_t nowtime;
+  char when[LOGTIME_MAX];
+
+  if (opencache(c) < 0)
+    return -1;
+  r->c = *c;
+  r->progname = progname;
+  r->failed = false;
+  if (r->c.visual) {
+    if (c->verbose)
+      fprintf(stderr, "%s: warning: -v ignored for %s\n", progname, sw);
+    r->c.visual = false;
+  }
+  if (r->c.tracefile) {
+    if (c->verbose)
+      fprintf(stderr, "%s: warning: -trace ignored for %s\n", progname, sw);
+    r->c.tracefile = NULL;
+  }
+  if (r->c.checkpointfile) {
+    if (c->verbose)
+      fprintf(stderr, "%s: warning: -checkpoint ignored for %s\n",
+              progname, sw);
+    r->c.checkpointfile = NULL;
+  }
+
+  switch (c->countonly ? NONE : c->ofiletype) {
+  case SINGLE:
+    r->fout = fopen(c->ofile, "w");
+    if (!r->fout) {
+      fprintf(stderr, "%s: can't write file\n", c->ofile);
+      return -1;
+    }
+    break;
+  case STDSTREAM:
+    r->fout = c->out;
+    break;
+  case MULTIPLE:
+  case ARCHIVE:
+    fprintf(stderr, "%s: inappropriate output (use -o, -os or +o)\n",
+            progname);
+    return -1;
+  default:
+    r->fout = NULL;
+    break;
+  }
+
+  r->logfp = NULL;
+  if (c->logfile) {
+    if (!(r->logfp = openlog(c)))
+      goto close_output;
+    time(&nowtime);
+    fprintf(r->logfp, "log started at %s\n", logtime(nowtime, when));
+    fflush(r->logfp);
+  }
+
+  r->statsfp = NULL;
+  if (c->statsfile) {
+    r->statsfp = fopen(c->statsfile, "a");
+    if (!r->statsfp) {
+      fprintf(stderr, "%s: could not open\n", c->statsfile);
+      goto close_log;
+    }
+  }
+
+  if (pool_init(&r->pool, c->threads, r->fout,
+                &solvelistitem, &emitlistitem, r) < 0) {
+    fprintf(stderr, "%s: could not start workers\n", progname);
+    goto close_stats;
+  }
+  return 0;
+
+close_stats:
+  if (r->statsfp)
+    fclose(r->statsfp);
+close_log:
+  if (r->logfp)
+    fclose(r->logfp);
+close_output:
+  if (r->fout && r->fout != c->out)
+    fclose(r->fout);
+  return -1;
+}
+
+/* Wait for all submitted puzzles to be solved and written. */
+static int endrun(struct listrun *r)
+{
+  time_t nowtime;
+  char when[LOGTIME_MAX];
+
+  pool_term(&r->pool);
+
+  if (r->statsfp)
+    fclose(r->statsfp);
+  if (r->logfp) {
+    time(&nowtime);
+    fprintf(r->logfp, "log ended at %s\n", logtime(nowtime, when));
+    fclose(r->logfp);
+  }
+  if (r->fout && r->fout != r->c.out)
+    fclose(r->fout);
+  return r->failed ? -1 : 0;
+}
+
+/* Read puzzle filenames from the input, one per line, and solve them
+   across worker threads, writing results in the order listed. */
+int solvelist(context *c, const char *progname)
+{
+  FILE *fin;
+  struct listrun run;
+  char name[FILENAME_MAX + 2];
+  int rc = 0;
+
+  droppuzzle(c);
+  if (c->ifile) {
+    fin = fopen(c->ifile, "r");
+    if (!fin) {
+      fprintf(stderr, "%s: could not read\n", c->ifile);
+      return -1;
+    }
+  } else {
+    fin = c->in;
+  }
+
+  if (startrun(&run, c, progname, "-xl") < 0) {
+    if (fin != c->in)
+      fclose(fin);
+    return -1;
+  }
+
+  while (fgets(name, sizeof name, fin)) {
+    struct listitem *it;
+    size_t len = strlen(name);
+
+    if (len > 0 && name[len - 1] == '\n')
+      name[--len] = '\0';
+    else if (!feof(fin)) {
+      fprintf(stderr, "%s: filename too long\n", progname);
+      rc = -1;
+      break;
+    }
+    if (len == 0)
+      continue;
+
+    if (!(it = newlistitem(name, len)) || pool_submit(&run.pool, it) < 0) {
+      if (it)
+        free(it->name);
+      free(it);
+      fprintf(stderr, "%s: out of memory\n", progname);
+      rc = -1;
+      break;
+    }
+  }
+
+  if (endrun(&run) < 0)
+    rc = -1;
+  if (run.c.expired)
+    c->expired = true;
+  if (fin != c->in)
+    fclose(fin);
+  return rc;
+}
+
+/* Skip space between concatenated puzzles, returning true if another
+   one follows. */
+static int morepuzzles(FILE *fp)
+{
+  int ch;
+
+  while ((ch = getc(fp)) != EOF)
+    if (ch != ' ' && ch != '\t' && ch != '\r' && ch != '\n') {
+      ungetc(ch, fp);
+      return true;
+    }
+  return false;
+}
+
+/* Keep reading puzzles from the input until it runs out, solving them
+   across worker threads while the next is parsed, and writing results
+   in the order read. */
+int solvestream(context *c, const char *progname)
+{
+  FILE *fin;
+  struct listrun run;
+  const char *src = c->ifile ? c->ifile : "stdin";
+  char name[FILENAME_MAX + 40];
+  unsigned long num = 0;
+  int rc = 0;
+
+  if (c->ifile) {
+    fin = fopen(c->ifile, "r");
+    if (!fin) {
+      fprintf(stderr, "%s: could not read\n", c->ifile);
+      return -1;
+    }
+  } else {
+    fin = c->in;
+  }
+
+  if (startrun(&run, c, progname, "-xa") < 0) {
+    if (fin != c->in)
+      fclose(fin);
+    return -1;
+  }
+
+  /* A puzzle already parsed from stdin is the first of the stream. */
+  if (!c->ifile && c->loaded) {
+    struct listitem *it;
+
+    num++;
+    sprintf(name, "%.*s#%lu", FILENAME_MAX, src, num);
+    if ((it = newlistitem(name, strlen(name)))) {
+      takepuzzle(c, progname, &it->puzzle);
+      it->loaded = true;
+      if (pool_submit(&run.pool, it) < 0) {
+        nonogram_freepuzzle(&it->puzzle);
+        free(it->name);
+        free(it);
+        it = NULL;
+      }
+    }
+    if (!it) {
+      fprintf(stderr, "%s: out of memory\n", progname);
+      rc = -1;
+    }
+  }
+  droppuzzle(c);
+
+  while (rc == 0 && morepuzzles(fin)) {
+    struct listitem *it;
+    double began;
+
+    num++;
+    sprintf(name, "%.*s#%lu", FILENAME_MAX, src, num);
+    if (!(it = newlistitem(name, strlen(name)))) {
+      fprintf(stderr, "%s: out of memory\n", progname);
+      rc = -1;
+      break;
+    }
+    began = monotime();
+    if (readpuzzle(c, &it->puzzle, fin) < 0) {
+      fprintf(stderr, "%s: error on input\n", name);
+      free(it->name);
+      free(it);
+      rc = -1;
+      break;
+    }
+    it->stats.parse = monotime() - began;
+    it->loaded = true;
+    if (pool_submit(&run.pool, it) < 0) {
+      fprintf(stderr, "%s: out of memory\n", progname);
+      nonogram_freepuzzle(&it->puzzle);
+      free(it->name);
+      free(it);
+      rc = -1;
+      break;
+    }
+  }
+
+  if (endrun(&run) < 0)
+    rc = -1;
+  if (run.c.expired)
+    c->expired = true;
+  if (fin != c->in)
+    fclose(fin);
+  return rc;
+}
+
+/* Each attempt at a puzzle has its own random sequence, derived from
+   the seed and the attempt number, so the puzzles kept depend only on
+   the seed, not on the number of threads. */
+static unsigned long long splitmix(unsigned long long *s)
+{
+  unsigned long long z = (*s += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+/* the attempts allowed for each puzzle asked for */
+#define GEN_MAXTRIES 1000
+
+struct genitem {
+  unsigned long long seed;
+  nonogram_puzzle puzzle;
+  unsigned made : 1, unique : 1, expired : 1;
+};
+
+struct genrun {
+  context c;
+  FILE *fout;
+  unsigned long want, kept, tried, expired;
+  int failed;
+#ifndef NOTHREADS
+  pthread_mutex_t lock;
+#endif
+};
+
+/* Make a random grid into a puzzle, and see if it has only one
+   solution.  A search cut short by -timeout or -maxsteps may have
+   missed the second, so proves nothing. */
+static void genpuzzle(void *vr, struct pool_job *j)
+{
+  struct genrun *r = vr;
+  struct genitem *it = j->data;
+  size_t i, cells = r->c.genwidth * r->c.genheight;
+  unsigned long long state = it->seed;
+  nonogram_cell *grid;
+  struct h_tag handle;
+
+  it->made = it->unique = it->expired = false;
+  grid = nonogram_makegrid(r->c.genwidth, r->c.genheight);
+  if (!grid)
+    return;
+  for (i = 0; i < cells; i++)
+    grid[i] = splitmix(&state) % 100 < r->c.gendensity ?
+      nonogram_SOLID : nonogram_DOT;
+  if (nonogram_makepuzzle(&it->puzzle, grid,
+                          r->c.genwidth, r->c.genheight) < 0) {
+    nonogram_freegrid(grid);
+    return;
+  }
+  nonogram_freegrid(grid);
+  it->made = true;
+  if (r->c.title)
+    nonogram_settitle(&it->puzzle, r->c.title);
+
+  /* Stop at a second solution. */
+  handle.c = &r->c;
+  handle.puzzle = it->puzzle;
+  handle.fp = handle.logfp = NULL;
+  handle.keep = NULL;
+  clearstats(&handle.stats);
+  handle.trace.fp = NULL;
+  handle.ckkey = NULL;
+  handle.skip = 0;
+  if (searchpuzzle(&handle, "generated") == 0) {
+    it->expired = handle.expired;
+    it->unique = !handle.expired && handle.solno == 1;
+  }
+}
+
+static void emitpuzzle(void *vr, struct pool_job *j)
+{
+  struct genrun *r = vr;
+  struct genitem *it = j->data;
+  char fname[400];
+  FILE *fp;
+
+  /* Attempts made after enough have been found are dropped. */
+  if (r->kept < r->want) {
+    r->tried++;
+    if (it->expired)
+      r->expired++;
+  }
+  if (it->made && it->unique && r->kept < r->want) {
+    switch (r->c.ofiletype) {
+    case MULTIPLE:
+      sprintf(fname, r->c.ofile, (int) (r->kept + 1));
+      fp = fopen(fname, "w");
+      if (!fp) {
+        fprintf(stderr, "%s: can't write file\n", fname);
+        r->failed = true;
+        break;
+      }
+      nonogram_fprintpuzzle(&it->puzzle, fp);
+      fclose(fp);
+      break;
+    case SINGLE:
+    case STDSTREAM:
+      if (r->kept > 0)
+        fprintf(r->fout, "\n");
+      nonogram_fprintpuzzle(&it->puzzle, r->fout);
+      break;
+    }
+#ifndef NOTHREADS
+    pthread_mutex_lock(&r->lock);
+#endif
+    r->kept++;
+#ifndef NOTHREADS
+    pthread_mutex_unlock(&r->lock);
+#endif
+  }
+  if (it->made)
+    nonogram_freepuzzle(&it->puzzle);
+  free(it);
+}
+
+/* Generate random puzzles with unique solutions until enough have been
+   found, trying several at once. */
+int generate(context *c, const char *progname, unsigned long want)
+{
+  struct genrun run;
+  struct pool pool;
+  unsigned long long seed = c->seed, attempt;
+  unsigned long kept;
+  double began, took;
+
+  run.c = *c;
+  run.c.limit = 2;
+  run.c.countonly = true;
+  run.c.visual = false;
+  run.c.race = false;
+  run.c.verbose = false;  /* attempts out of time are summed instead */
+  run.c.statsfile = NULL;
+  run.c.tracefile = NULL;
+  run.want = want;
+  run.kept = run.tried = run.expired = 0;
+  run.failed = false;
+
+  switch (c->ofiletype) {
+  case SINGLE:
+    run.fout = fopen(c->ofile, "w");
+    if (!run.fout) {
+      fprintf(stderr, "%s: can't write file\n", c->ofile);
+      return -1;
+    }
+    break;
+  case STDSTREAM:
+    run.fout = c->out;
+    break;
+  case ARCHIVE:
+    fprintf(stderr, "%s: inappropriate output (use -o, -os, -on or +o)\n",
+            progname);
+    return -1;
+  default:
+    run.fout = NULL;
+    break;
+  }
+
+  if (!c->seeded)
+    seed = (unsigned long long) time(NULL);
+#ifndef NOTHREADS
+  pthread_mutex_init(&run.lock, NULL);
+#endif
+  if (pool_init(&pool, c->threads, NULL, &genpuzzle, &emitpuzzle, &run) < 0) {
+    fprintf(stderr, "%s: could not start workers\n", progname);
+#ifndef NOTHREADS
+    pthread_mutex_destroy(&run.lock);
+#endif
+    if (run.fout && run.fout != c->out)
+      fclose(run.fout);
+    return -1;
+  }
+
+  began = monotime();
+  for (attempt = 0; attempt < (unsigned long long) want * GEN_MAXTRIES;
+       attempt++) {
+    struct genitem *it;
+    unsigned long long s = seed ^ (attempt * 0xd1b54a32d192ed03ULL);
+
+#ifndef NOTHREADS
+    pthread_mutex_lock(&run.lock);
+#endif
+    kept = run.kept;
+#ifndef NOTHREADS
+    pthread_mutex_unlock(&run.lock);
+#endif
+    if (kept >= want || run.failed)
+      break;
+
+    if ((it = malloc(sizeof *it)) != NULL)
+      it->seed = splitmix(&s);
+    if (!it || pool_submit(&pool, it) < 0) {
+      free(it);
+      fprintf(stderr, "%s: out of memory\n", progname);
+      run.failed = true;
+      break;
+    }
+  }
+  pool_term(&pool);
+  took = monotime() - began;
+#ifndef NOTHREADS
+  pthread_mutex_destroy(&run.lock);
+#endif
+
+  if (run.fout && run.fout != c->out)
+    fclose(run.fout);
+  if (c->verbose)
+    fprintf(stderr, "%lu unique %lux%lu puzzles from %lu attempts"
+            " (%lu out of time)"
+            " in %.3fs (%.1f per second, seed %llu)\n",
+            run.kept, c->genwidth, c->genheight, run.tried, run.expired,
+            took, took > 0 ? run.kept / took : 0.0, seed);
+  if (run.kept < want && !run.failed)
+    fprintf(stderr, "%s: only %lu of %lu puzzles found\n",
+            progname, run.kept, want);
+  return run.kept < want ? -1 : 0;
+}
+
+/* the line solvers compared by -bench; the null solver makes no
+   deductions, so is left out */
+static const int bench_algos[] = {
+  nonogram_AFAST, nonogram_ACOMPLETE, nonogram_AHYBRID, nonogram_AFCOMP,
+  nonogram_AFFCOMP, nonogram_AOLSAK, nonogram_AFASTOLSAK,
+  nonogram_AFASTODDONES, nonogram_AFASTOLSAKCOMPLETE,
+  nonogram_AFASTODDONESCOMPLETE
+};
+#define BENCHES (sizeof bench_algos / sizeof bench_algos[0])
+
+struct benchresult {
+  double took;
+  unsigned long long steps, solno;
+  unsigned complete : 1;
+};
+
+/* Count the solutions of a puzzle with one line solver, stepping as
+   -x does. */
+static void benchalgo(context *c, const nonogram_puzzle *puzzle, int algo,
+                      struct benchresult *r)
+{
+  struct h_tag h;
+  struct quantum q;
+  double began;
+
+  h.c = c;
+  h.puzzle = *puzzle;
+  h.solno = 0;
+  h.stop = false;
+  h.keep = NULL;
+
+  began = monotime();
+  nonogram_initsolver(&h.solver);
+  h.grid = nonogram_makegrid(nonogram_puzzlewidth(puzzle),
+                             nonogram_puzzleheight(puzzle));
+  nonogram_cleargrid(h.grid, nonogram_puzzlewidth(puzzle),
+                     nonogram_puzzleheight(puzzle));
+  nonogram_setalgo(&h.solver, algo);
+  nonogram_setclient(&h.solver, c->limit > 0 ?
+                     &our_limited_counter : &our_counter, &h);
+  nonogram_load(&h.solver, puzzle, h.grid,
+                nonogram_puzzlewidth(puzzle) * nonogram_puzzleheight(puzzle));
+
+  quantum_init(&q, c->quantum);
+  r->steps = 0;
+  r->complete = false;
+  while (!h.stop) {
+    if (quantum_run(&q, &h.solver, &r->steps) == nonogram_FINISHED) {
+      r->complete = true;
+      break;
+    }
+  }
+  r->took = monotime() - began;
+  r->solno = h.solno;
+
+  nonogram_termsolver(&h.solver);
+  nonogram_freegrid(h.grid);
+}
+
+static void printbench(FILE *fp, const char *name, int algo,
+                       const struct benchresult *r)
+{
+  fprintf(fp, "%s: %-18s %10.4fs %12llu steps %10llu solutions%s",
+          name, algoname(algo), r->took, r->steps, r->solno,
+          r->complete ? "" : "+");
+  if (r->took > 0)
+    fprintf(fp, " %12.1f/s\n", r->solno / r->took);
+  else
+    fprintf(fp, " %12s\n", "-");
+}
+
+static void printbenchjson(FILE *fp, const char *name, int algo,
+                           const struct benchresult *r)
+{
+  fprintf(fp, "{\"puzzle\":");
+  fprintjsonstr(fp, name);
+  fprintf(fp, ",\"algorithm\":\"%s\",\"library\":\"%d.%d.%d\","
+          "\"seconds\":%.6f,\"steps\":%llu,\"solutions\":%llu,"
+          "\"complete\":%s,\"rate\":%.1f}\n",
+          algoname(algo), nonogram_VERSION, nonogram_MINOR,
+          nonogram_PATCHLEVEL, r->took, r->steps, r->solno,
+          r->complete ? "true" : "false",
+          r->took > 0 ? r->solno / r->took : 0.0);
+}
+
+/* Load a puzzle, and time each line solver on it. */
+int bench(context *c, const char *progname)
+{
+  FILE *fout;
+  nonogram_puzzle *puzzle;
+  const char *name = c->ifile ? c->ifile : "stdin";
+  struct benchresult r;
+  size_t i;
+
+  if (!(puzzle = getpuzzle(c, progname)))
+    return -1;
+
+  switch (c->ofiletype) {
+  case SINGLE:
+    fout = fopen(c->ofile, "w");
+    if (!fout) {
+      fprintf(stderr, "%s: can't write file\n", c->ofile);
+      return -1;
+    }
+    break;
+  case STDSTREAM:
+    fout = c->out;
+    break;
+  case MULTIPLE:
+  case ARCHIVE:
+    fprintf(stderr, "%s: inappropriate output (use -o, -os or +o)\n",
+            progname);
+    return -1;
+  default:
+    fout = NULL;
+    break;
+  }
+
+  for (i = 0; i < BENCHES; i++) {
+    benchalgo(c, puzzle, bench_algos[i], &r);
+    if (c->json) {
+      if (fout)
+        printbenchjson(fout, name, bench_algos[i], &r);
+      if (c->verbose)
+        printbench(stderr, name, bench_algos[i], &r);
+    } else if (fout) {
+      printbench(fout, name, bench_algos[i], &r);
+    }
+    if (fout)
+      fflush(fout);
+  }
+
+  if (fout && fout != c->out)
+    fclose(fout);
+  return 0;
+}
+
+int print_usage(FILE *fp, const char *progname)
+{
+  int count = 0;
+
+  count += fprintf(fp, "usage: %s [-o output] [-on out%%dput] [-oa archive]"
+                   " [-os] [+o]\n"
+                   "\t[-ofd num]\n", progname);
+  count += fprintf(fp, "\t"
+#ifndef NOVISUAL
+                   "[-/+v] "
+#endif
+                   "[-/+table] [-(n)log logfile] [+(n)log] [-ll level]\n"
+                   "\t[-logbuf KiB] [+logbuf]\n"
+                   "\t[-cache file] [+cache] [-stats file] [+stats]"
+                   " [-trace file] [+trace]\n"
+                   "\t[-checkpoint file] [+checkpoint] [-/+resume]\n");
+  count += fprintf(fp, "\t[-html] [-dot str] [-solid str]"
+                   " [-blank str] [+dot/solid/blank]\n"
+                   "\t[-unknown str] [+unknown]\n");
+  count += fprintf(fp, "\t[+html] [-dot str] [-solid str]"
                    " [-blank str] [+dot/solid/blank]\n"
-                   "\t[-i input] [-is] [-s num] [+s] [-h] [-L] [-O]\n"
-                   "\t[-/+CO] [-/+CE] [-/+q]\n"
-                   "\t[-penc]\n"
+                   "\t[-i input] [-is] [-ifd num] [-istr puzzle]\n"
+                   "\t[-s num] [+s] [-h] [-L] [-O]\n"
+                   "\t[-/+CO] [-/+CE] [-/+count] [-/+q] [-/+bin] [-/+json]\n"
+                   "\t[-hash] [-hashsort] [+hash]\n"
+                   "\t[-penc] [-/+enc]\n"
                    "\t[-Affcomp] [-Afcomp] [-Afast] [-Anull] [-Acomplete]"
                    " [-Ahybrid]\n"
-                   "\t[-Aolsak] [-Afastolsak]\n"
+                   "\t[-Aolsak] [-Afastolsak] [-Arace]\n"
                    "\t[-Afastodd] [-Afastolsakcomplete] [-Afastoddcomplete]\n"
-                   "\t[-title string]\n");
+                   "\t[-title string] [-threads num] [-quantum num]\n"
+                   "\t[-timeout ms] [+timeout] [-maxsteps num] [+maxsteps]\n"
+                   "\t[-size WxH] [-density pct] [-seed num]\n");
 #ifndef OLDSWITCHES
-  count += fprintf(fp, "\t[-p] [-x] [-c] [-g] [-j] [-T] [-W] [-H]\n");
+  count += fprintf(fp, "\t[-p] [-x] [-xl] [-xa] [-decode] [-extract num]"
+                   " [-bench]\n"
+                   "\t[-c] [-g] [-j] [-T] [-W] [-H]\n");
+  count += fprintf(fp, "\t[-daemon socket|-] [-batch jobs|-]\n");
   count += fprintf(fp, "\t[-Xname] [-Rname value] [-Dname]"
-                   " [-Sname value]\n");
+                   " [-Sname value] [-G num]\n");
 #endif
   return count;
 }
@@ -678,29 +2259,60 @@ int print_options(FILE *fp, const char *pname)
   count += fprintf(fp, "BBCVDU: use BBC VDU 31 codes for -v\n");
 #endif
 
+#if defined(NOTHREADS)
+  count += fprintf(fp, "NOTHREADS: -xl and -xa solve puzzles one at a time,"
+                   " and -Arace is disabled\n");
+#endif
+
   return count;
 }
 
 void init_context(context *p)
 {
   p->verbose = true;
-  p->html = p->error = false;
+  p->html = p->error = p->binary = p->json = false;
+  p->hash = p->hashsort = false;
   p->title = NULL;
   p->table = true;
-  p->countonerr = p->countonout = false;
+  p->countonerr = p->countonout = p->countonly = false;
   p->html_dot = default_html_dot;
   p->html_solid = default_html_solid;
   p->html_blank = default_html_blank;
   p->dot = default_dot;
   p->solid = default_solid;
   p->blank = default_blank;
+  p->unknown = default_unknown;
   p->visual = false;
   p->ofiletype = STDSTREAM;
   p->logfile = NULL;
+  p->cachefile = NULL;
+  p->statsfile = NULL;
+  p->tracefile = NULL;
+  p->checkpointfile = NULL;
+  p->resume = false;
+  p->cache = NULL;
+  p->job = p->remote = false;
   p->loglevel = 0;
   p->logappend = true;
   p->limit = 0;
+  p->threads = 0;
+  p->quantum = 0;
+  p->timeout = 0;
+  p->logbuf = 0;
+  p->maxsteps = 0;
+  p->expired = false;
+  p->genwidth = p->genheight = 10;
+  p->gendensity = 50;
+  p->seed = 0;
+  p->seeded = false;
   p->algo = nonogram_AFFCOMP;
+  p->race = false;
+  p->loaded = false;
+  p->encoded = false;
+  p->in = p->stdinput = stdin;
+  p->out = p->stdoutput = stdout;
+  p->infd = p->outfd = -1;
+  p->ownin = p->ownout = false;
 #ifndef NOAUTOEXEC
   p->executed = true;
 #endif
@@ -709,20 +2321,87 @@ void init_context(context *p)
 #endif
 }
 
+/* Close a stream opened by -ifd or -istr, and go back to the
+   standard input. */
+void releaseinput(context *p)
+{
+  if (p->ownin)
+    fclose(p->in);
+  p->in = p->stdinput;
+  p->infd = -1;
+  p->ownin = false;
+}
+
+void releaseoutput(context *p)
+{
+  if (p->ownout)
+    fclose(p->out);
+  p->out = p->stdoutput;
+  p->outfd = -1;
+  p->ownout = false;
+}
+
+/* The descriptor is duplicated, so that closing the stream leaves the
+   caller's descriptor open. */
+static FILE *openfd(const char *arg, const char *mode, int *fdp,
+                    const char *pname)
+{
+  char *end;
+  long n = strtol(arg, &end, 10);
+  int fd;
+  FILE *fp;
+
+  if (end == arg || *end || n < 0 || n > INT_MAX) {
+    fprintf(stderr, "%s: bad descriptor %s\n", pname, arg);
+    return NULL;
+  }
+  fd = dup(n);
+  if (fd < 0) {
+    fprintf(stderr, "%s: descriptor %ld: %s\n", pname, n, strerror(errno));
+    return NULL;
+  }
+  fp = fdopen(fd, mode);
+  if (!fp) {
+    fprintf(stderr, "%s: descriptor %ld: %s\n", pname, n, strerror(errno));
+    close(fd);
+    return NULL;
+  }
+  *fdp = n;
+  return fp;
+}
+
+void term_context(context *p)
+{
+  droppuzzle(p);
+  releaseinput(p);
+  releaseoutput(p);
+  cache_close(p->cache);
+  p->cache = NULL;
+}
+
 int print_context(context *p, FILE *fp)
 {
   int count = 0;
 
 #ifndef OLDSWITCHES
-  count += fprintf(fp, p->ifile ? "Input:\tfile %s\n" : "Input:\tstdin\n",
-                   p->ifile);
+  if (p->ifile)
+    count += fprintf(fp, "Input:\tfile %s\n", p->ifile);
+  else if (p->infd >= 0)
+    count += fprintf(fp, "Input:\tdescriptor %d\n", p->infd);
+  else if (p->ownin)
+    count += fprintf(fp, "Input:\tstring\n");
+  else
+    count += fprintf(fp, "Input:\tstdin\n");
 #endif
   switch (p->ofiletype) {
   case NONE:
     count += fprintf(fp, "Output:\tnone\n");
     break;
   case STDSTREAM:
-    count += fprintf(fp, "Output:\tstdout\n");
+    if (p->outfd >= 0)
+      count += fprintf(fp, "Output:\tdescriptor %d\n", p->outfd);
+    else
+      count += fprintf(fp, "Output:\tstdout\n");
     break;
   case MULTIPLE:
     count += fprintf(fp, "Output:\tfiles %s\n", p->ofile);
@@ -730,9 +2409,18 @@ int print_context(context *p, FILE *fp)
   case SINGLE:
     count += fprintf(fp, "Output:\tfile %s\n", p->ofile);
     break;
+  case ARCHIVE:
+    count += fprintf(fp, "Output:\tarchive %s\n", p->ofile);
+    break;
   }
+  count += fprintf(fp, "Input format:\t%s\n",
+                   p->encoded ? "encoded" : "text");
   count += fprintf(fp, "HTML:\t%sabled\n", p->html ? "en" : "dis");
   count += fprintf(fp, "Table:\t%sabled\n", p->table ? "en" : "dis");
+  count += fprintf(fp, "Binary:\t%sabled\n", p->binary ? "en" : "dis");
+  count += fprintf(fp, "Hashes:\t%s\n", !p->hash ? "disabled" :
+                   p->hashsort ? "sorted" : "enabled");
+  count += fprintf(fp, "JSON:\t%sabled\n", p->json ? "en" : "dis");
   count += fprintf(fp, "Informational:\t%s\n",
                    p->verbose ? "verbose" : "silent");
   count += fprintf(fp, "Solution limit:\t");
@@ -744,25 +2432,65 @@ int print_context(context *p, FILE *fp)
                    p->countonout ? "en" : "dis");
   count += fprintf(fp, "Count on stderr:\t%sabled\n",
                    p->countonerr ? "en" : "dis");
+  count += fprintf(fp, "Count only:\t%sabled\n",
+                   p->countonly ? "en" : "dis");
   count += fprintf(fp, "Visual:\t%s\n", p->visual ? "on" : "off");
+  count += fprintf(fp, "Threads:\t");
+  if (p->threads)
+    count += fprintf(fp, "%u\n", p->threads);
+  else
+    count += fprintf(fp, "automatic\n");
+  count += fprintf(fp, "Quantum:\t");
+  if (p->quantum > 0)
+    count += fprintf(fp, "%d steps\n", p->quantum);
+  else
+    count += fprintf(fp, "adaptive\n");
+  count += fprintf(fp, "Time limit:\t");
+  if (p->timeout > 0)
+    count += fprintf(fp, "%lu ms\n", p->timeout);
+  else
+    count += fprintf(fp, "none\n");
+  count += fprintf(fp, "Step limit:\t");
+  if (p->maxsteps > 0)
+    count += fprintf(fp, "%llu steps\n", p->maxsteps);
+  else
+    count += fprintf(fp, "none\n");
   if (p->logfile)
     count += fprintf(fp, "Log:\tfile %s\n", p->logfile);
   else
     count += fprintf(fp, "Log:\toff\n");
   count += fprintf(fp, "Log level:\t%u\n", p->loglevel);
-  count += fprintf
-    (fp, "Line solver:\t%s\n",
-     p->algo == nonogram_AFASTODDONES ? "fastodd" :
-     p->algo == nonogram_AFASTOLSAK ? "fastolsak" :
-     p->algo == nonogram_AFASTODDONESCOMPLETE ? "fastoddcomplete" :
-     p->algo == nonogram_AFASTOLSAKCOMPLETE ? "fastolsakcomplete" :
-     p->algo == nonogram_AOLSAK ? "olsak" :
-     p->algo == nonogram_AHYBRID ? "hybrid" :
-     p->algo == nonogram_AFAST ? "fast" :
-     p->algo == nonogram_AFCOMP ? "fcomp" :
-     p->algo == nonogram_AFFCOMP ? "ffcomp" :
-     p->algo == nonogram_ANULL ? "null" :
-     p->algo == nonogram_ACOMPLETE ? "complete" : "unknown");
+  count += fprintf(fp, "Log buffer:\t");
+  if (p->logbuf > 0)
+    count += fprintf(fp, "%zu bytes\n", p->logbuf);
+  else
+    count += fprintf(fp, "none\n");
+  if (p->cachefile)
+    count += fprintf(fp, "Cache:\tfile %s\n", p->cachefile);
+  else
+    count += fprintf(fp, "Cache:\toff\n");
+  if (p->statsfile)
+    count += fprintf(fp, "Stats:\tfile %s\n", p->statsfile);
+  else
+    count += fprintf(fp, "Stats:\toff\n");
+  if (p->tracefile)
+    count += fprintf(fp, "Trace:\tfile %s\n", p->tracefile);
+  else
+    count += fprintf(fp, "Trace:\toff\n");
+  if (p->checkpointfile)
+    count += fprintf(fp, "Checkpoint:\tfile %s%s\n", p->checkpointfile,
+                     p->resume ? ", resuming" : "");
+  else
+    count += fprintf(fp, "Checkpoint:\toff\n");
+  count += fprintf(fp, "Line solver:\t%s\n",
+                   p->race ? "race" : algoname(p->algo));
+  count += fprintf(fp, "Generated size:\t%lux%lu\n",
+                   p->genwidth, p->genheight);
+  count += fprintf(fp, "Generated density:\t%u%%\n", p->gendensity);
+  if (p->seeded)
+    count += fprintf(fp, "Seed:\t%llu\n", p->seed);
+  else
+    count += fprintf(fp, "Seed:\ttime\n");
   if (p->title)
     count += fprintf(fp, "Title: \"%s\"\n", p->title);
   else
@@ -771,6 +2499,7 @@ int print_context(context *p, FILE *fp)
   count += fprintf(fp, "Dot:\t%s\n", p->dot);
   count += fprintf(fp, "Solid:\t%s\n", p->solid);
   count += fprintf(fp, "Blank:\t%s\n", p->blank);
+  count += fprintf(fp, "Unknown:\t%s\n", p->unknown);
   count += fprintf(fp, "HTML output:\n");
   count += fprintf(fp, "Dot:\t%s\n", p->html_dot);
   count += fprintf(fp, "Solid:\t%s\n", p->html_solid);
@@ -778,12 +2507,43 @@ int print_context(context *p, FILE *fp)
   return count;
 }
 
+/* switches refused in a job, as they would change what it shares with
+   the context it was copied from, reach the process's descriptors or
+   terminal, or start jobs of their own */
+static const char *const job_refused[] = {
+  "-cache", "+cache", "-ifd", "-ofd", "-v", "-daemon", "-batch", NULL
+};
+
+/* switches also refused to a -daemon client, as they name files */
+static const char *const remote_refused[] = {
+  "-i", "-xl", "-o", "-on", "-oa", "-log", "-nlog", "-stats", "-trace",
+  "-checkpoint", NULL
+};
+
+static int listed(const char *const *list, const char *sw)
+{
+  for (; *list; list++)
+    if (!strcmp(*list, sw))
+      return true;
+  return false;
+}
+
 int parse_args(context *c, int argc, const char *argv[], const char *pname)
 {
   int arg = 0;
 
   while (arg < argc) {
-    if (argv[arg][0] == '-') {
+    if (c->job && listed(job_refused, argv[arg])) {
+      c->error = true;
+      fprintf(stderr, "%s: switch %s not allowed in a job\n",
+              pname, argv[arg]);
+      arg = argc;
+    } else if (c->remote && listed(remote_refused, argv[arg])) {
+      c->error = true;
+      fprintf(stderr, "%s: switch %s not allowed from a client\n",
+              pname, argv[arg]);
+      arg = argc;
+    } else if (argv[arg][0] == '-') {
       if (!strcmp(argv[arg] + 1, "html")) {
 #ifndef NOAUTOEXEC
         c->executed = false;
@@ -796,6 +2556,26 @@ int parse_args(context *c, int argc, const char *argv[], const char *pname)
 #endif
         c->table = true;
         arg++;
+      } else if (!strcmp(argv[arg] + 1, "bin")) {
+#ifndef NOAUTOEXEC
+        c->executed = false;
+#endif
+        c->binary = true;
+        arg++;
+      } else if (!strcmp(argv[arg] + 1, "hash") ||
+                 !strcmp(argv[arg] + 1, "hashsort")) {
+#ifndef NOAUTOEXEC
+        c->executed = false;
+#endif
+        c->hash = true;
+        c->hashsort = argv[arg][5] != '\0';
+        arg++;
+      } else if (!strcmp(argv[arg] + 1, "json")) {
+#ifndef NOAUTOEXEC
+        c->executed = false;
+#endif
+        c->json = true;
+        arg++;
       } else if (!strcmp(argv[arg] + 1, "v")) {
 #ifndef NOAUTOEXEC
         c->executed = false;
@@ -810,8 +2590,35 @@ int parse_args(context *c, int argc, const char *argv[], const char *pname)
 #ifndef NOAUTOEXEC
         c->executed = false;
 #endif
+        releaseoutput(c);
         c->ofiletype = STDSTREAM;
         arg++;
+      } else if (!strcmp(argv[arg] + 1, "ofd")) {
+        FILE *fp;
+        int fd;
+
+        if (arg + 1 >= argc) {
+          c->error = true;
+          fprintf(stderr, "%s: switch %s needs descriptor argument\n",
+                  pname, argv[arg]);
+          arg = argc;
+          continue;
+        }
+#ifndef NOAUTOEXEC
+        c->executed = false;
+#endif
+        fp = openfd(argv[arg + 1], "w", &fd, pname);
+        if (!fp) {
+          c->error = true;
+          arg = argc;
+          continue;
+        }
+        releaseoutput(c);
+        c->out = fp;
+        c->outfd = fd;
+        c->ownout = true;
+        c->ofiletype = STDSTREAM;
+        arg += 2;
       } else if (!strcmp(argv[arg] + 1, "h")) {
         print_usage(stderr, pname);
         arg++;
@@ -823,101 +2630,248 @@ int parse_args(context *c, int argc, const char *argv[], const char *pname)
         arg++;
       } else if (!strcmp(argv[arg] + 1, "Afast")) {
         c->algo = nonogram_AFAST;
+        c->race = false;
 #ifndef NOAUTOEXEC
         c->executed = false;
 #endif
         arg++;
       } else if (!strcmp(argv[arg] + 1, "Afcomp")) {
         c->algo = nonogram_AFCOMP;
+        c->race = false;
 #ifndef NOAUTOEXEC
         c->executed = false;
 #endif
         arg++;
       } else if (!strcmp(argv[arg] + 1, "Affcomp")) {
         c->algo = nonogram_AFFCOMP;
+        c->race = false;
 #ifndef NOAUTOEXEC
         c->executed = false;
 #endif
         arg++;
       } else if (!strcmp(argv[arg] + 1, "Acomplete")) {
         c->algo = nonogram_ACOMPLETE;
+        c->race = false;
 #ifndef NOAUTOEXEC
         c->executed = false;
 #endif
         arg++;
       } else if (!strcmp(argv[arg] + 1, "Anull")) {
         c->algo = nonogram_ANULL;
+        c->race = false;
 #ifndef NOAUTOEXEC
         c->executed = false;
 #endif
         arg++;
       } else if (!strcmp(argv[arg] + 1, "Ahybrid")) {
         c->algo = nonogram_AHYBRID;
+        c->race = false;
 #ifndef NOAUTOEXEC
         c->executed = false;
 #endif
         arg++;
       } else if (!strcmp(argv[arg] + 1, "Afastolsak")) {
         c->algo = nonogram_AFASTOLSAK;
+        c->race = false;
 #ifndef NOAUTOEXEC
         c->executed = false;
 #endif
         arg++;
       } else if (!strcmp(argv[arg] + 1, "Afastodd")) {
         c->algo = nonogram_AFASTODDONES;
+        c->race = false;
 #ifndef NOAUTOEXEC
         c->executed = false;
 #endif
         arg++;
       } else if (!strcmp(argv[arg] + 1, "Afastolsakcomplete")) {
         c->algo = nonogram_AFASTOLSAKCOMPLETE;
+        c->race = false;
 #ifndef NOAUTOEXEC
         c->executed = false;
 #endif
         arg++;
       } else if (!strcmp(argv[arg] + 1, "Afastoddcomplete")) {
         c->algo = nonogram_AFASTODDONESCOMPLETE;
+        c->race = false;
 #ifndef NOAUTOEXEC
         c->executed = false;
 #endif
         arg++;
       } else if (!strcmp(argv[arg] + 1, "Aolsak")) {
         c->algo = nonogram_AOLSAK;
+        c->race = false;
+#ifndef NOAUTOEXEC
+        c->executed = false;
+#endif
+        arg++;
+      } else if (!strcmp(argv[arg] + 1, "Arace")) {
+#ifdef NOTHREADS
+        if (c->verbose)
+          fprintf(stderr, "%s: warning: -Arace disabled\n", pname);
+#else
+        c->race = true;
+#endif
+#ifndef NOAUTOEXEC
+        c->executed = false;
+#endif
+        arg++;
+      } else if (!strcmp(argv[arg] + 1, "CO")) {
+        c->countonout = true;
+        arg++;
+      } else if (!strcmp(argv[arg] + 1, "CE")) {
+        c->countonerr = true;
+        arg++;
+      } else if (!strcmp(argv[arg] + 1, "count")) {
+#ifndef NOAUTOEXEC
+        c->executed = false;
+#endif
+        c->countonly = true;
+        arg++;
+      } else if (!strcmp(argv[arg] + 1, "Gdot") ||
+                 !strcmp(argv[arg] + 1, "Gsolid")) {
+        if (c->verbose)
+          fprintf(stderr, "warning: %s ignored\n", argv[arg]);
+        arg++;
+      } else if (!strcmp(argv[arg] + 1, "is")) {
+#ifndef NOAUTOEXEC
+        c->executed = false;
+#endif
+        droppuzzle(c);
+        releaseinput(c);
+        c->ifile = NULL;
+#ifdef OLDSWITCHES
+        if (solve(c, pname))
+          return EXIT_FAILURE;
+#endif
+        arg++;
+      } else if (!strcmp(argv[arg] + 1, "ifd") ||
+                 !strcmp(argv[arg] + 1, "istr")) {
+        FILE *fp;
+        int fd, isfd = argv[arg][2] == 'f';
+
+        if (arg + 1 >= argc) {
+          c->error = true;
+          fprintf(stderr, "%s: switch %s needs %s argument\n",
+                  pname, argv[arg], isfd ? "descriptor" : "string");
+          arg = argc;
+          continue;
+        }
+#ifndef NOAUTOEXEC
+        c->executed = false;
+#endif
+        droppuzzle(c);
+        c->ifile = NULL;
+        if (isfd && c->ownin && c->infd == atoi(argv[arg + 1])) {
+          /* Keep reading the same stream, and whatever it has
+             buffered. */
+          fp = c->in;
+        } else if (isfd) {
+          fp = openfd(argv[arg + 1], "r", &fd, pname);
+        } else {
+          const char *text = argv[arg + 1];
+          size_t len = strlen(text);
+
+          /* A puzzle in the text format has several lines, so one
+             line is an encoding from -penc, unless -enc already reads
+             it as one. */
+          while (len > 0 && (text[len - 1] == '\n' || text[len - 1] == '\r'))
+            len--;
+          fd = -1;
+          if (!c->encoded && len > 0 && !memchr(text, '\n', len)) {
+            fp = encoding_open(text, len);
+            if (!fp)
+              fprintf(stderr, "%s: %s: bad encoding\n", pname, argv[arg]);
+          } else {
+            fp = fmemopen((void *) text, strlen(text), "r");
+            if (!fp)
+              fprintf(stderr, "%s: %s: %s\n", pname, argv[arg],
+                      strerror(errno));
+          }
+        }
+        if (!fp) {
+          c->error = true;
+          arg = argc;
+          continue;
+        }
+        if (fp != c->in) {
+          releaseinput(c);
+          c->in = fp;
+          c->infd = fd;
+          c->ownin = true;
+        }
+#ifdef OLDSWITCHES
+        if (solve(c, pname))
+          return EXIT_FAILURE;
+#endif
+        arg += 2;
+      } else if (!strcmp(argv[arg] + 1, "title")) {
+        if (arg + 1 >= argc) {
+          c->error = true;
+          fprintf(stderr, "%s: switch %s needs string argument\n",
+                  pname, argv[arg]);
+          arg = argc;
+        } else {
+          c->title = argv[arg + 1];
+          arg += 2;
+        }
+      } else if (!strcmp(argv[arg] + 1, "cache")) {
+        if (arg + 1 >= argc) {
+          c->error = true;
+          fprintf(stderr, "%s: switch %s needs string argument\n",
+                  pname, argv[arg]);
+          arg = argc;
+        } else {
+          cache_close(c->cache);
+          c->cache = NULL;
+          c->cachefile = argv[arg + 1];
+          arg += 2;
+        }
+      } else if (!strcmp(argv[arg] + 1, "stats")) {
+#ifndef NOAUTOEXEC
+        c->executed = false;
+#endif
+        if (arg + 1 >= argc) {
+          c->error = true;
+          fprintf(stderr, "%s: switch %s needs string argument\n",
+                  pname, argv[arg]);
+          arg = argc;
+        } else {
+          c->statsfile = argv[arg + 1];
+          arg += 2;
+        }
+      } else if (!strcmp(argv[arg] + 1, "trace")) {
 #ifndef NOAUTOEXEC
         c->executed = false;
 #endif
-        arg++;
-      } else if (!strcmp(argv[arg] + 1, "CO")) {
-        c->countonout = true;
-        arg++;
-      } else if (!strcmp(argv[arg] + 1, "CE")) {
-        c->countonerr = true;
-        arg++;
-      } else if (!strcmp(argv[arg] + 1, "Gdot") ||
-                 !strcmp(argv[arg] + 1, "Gsolid")) {
-        if (c->verbose)
-          fprintf(stderr, "warning: %s ignored\n", argv[arg]);
-        arg++;
-      } else if (!strcmp(argv[arg] + 1, "is")) {
+        if (arg + 1 >= argc) {
+          c->error = true;
+          fprintf(stderr, "%s: switch %s needs string argument\n",
+                  pname, argv[arg]);
+          arg = argc;
+        } else {
+          c->tracefile = argv[arg + 1];
+          arg += 2;
+        }
+      } else if (!strcmp(argv[arg] + 1, "checkpoint")) {
 #ifndef NOAUTOEXEC
         c->executed = false;
 #endif
-        c->ifile = NULL;
-#ifdef OLDSWITCHES
-        if (solve(c, pname))
-          return EXIT_FAILURE;
-#endif
-        arg++;
-      } else if (!strcmp(argv[arg] + 1, "title")) {
         if (arg + 1 >= argc) {
           c->error = true;
           fprintf(stderr, "%s: switch %s needs string argument\n",
                   pname, argv[arg]);
           arg = argc;
         } else {
-          c->title = argv[arg + 1];
+          c->checkpointfile = argv[arg + 1];
           arg += 2;
         }
+      } else if (!strcmp(argv[arg] + 1, "resume")) {
+#ifndef NOAUTOEXEC
+        c->executed = false;
+#endif
+        c->resume = true;
+        arg++;
       } else if (!strcmp(argv[arg] + 1, "log")) {
         if (arg + 1 >= argc) {
           c->error = true;
@@ -953,6 +2907,115 @@ int parse_args(context *c, int argc, const char *argv[], const char *pname)
           c->loglevel = nlev;
           arg += 2;
         }
+      } else if (!strcmp(argv[arg] + 1, "logbuf")) {
+        unsigned long kib;
+        char *rem;
+        if (arg + 1 >= argc ||
+            (kib = strtoul(argv[arg + 1], &rem, 10), *rem) ||
+            kib > LOGBUF_MAX) {
+          c->error = true;
+          fprintf(stderr, "%s: switch %s needs whole number argument\n",
+                  pname, argv[arg]);
+          arg = argc;
+        } else {
+          c->logbuf = kib * 1024;
+          arg += 2;
+        }
+      } else if (!strcmp(argv[arg] + 1, "threads")) {
+        unsigned nthr;
+        char *rem;
+        if (arg + 1 >= argc ||
+            (nthr = strtoul(argv[arg + 1], &rem, 10), *rem)) {
+          c->error = true;
+          fprintf(stderr, "%s: switch %s needs whole number argument\n",
+                  pname, argv[arg]);
+          arg = argc;
+        } else {
+          c->threads = nthr;
+          arg += 2;
+        }
+      } else if (!strcmp(argv[arg] + 1, "size")) {
+        unsigned long w, h;
+        char *rem;
+        if (arg + 1 >= argc ||
+            (w = strtoul(argv[arg + 1], &rem, 10), *rem != 'x') ||
+            (h = strtoul(rem + 1, &rem, 10), *rem) || w == 0 || h == 0) {
+          c->error = true;
+          fprintf(stderr, "%s: switch %s needs WxH argument\n",
+                  pname, argv[arg]);
+          arg = argc;
+        } else {
+          c->genwidth = w;
+          c->genheight = h;
+          arg += 2;
+        }
+      } else if (!strcmp(argv[arg] + 1, "density")) {
+        unsigned pct;
+        char *rem;
+        if (arg + 1 >= argc ||
+            (pct = strtoul(argv[arg + 1], &rem, 10), *rem) || pct > 100) {
+          c->error = true;
+          fprintf(stderr, "%s: switch %s needs percentage argument\n",
+                  pname, argv[arg]);
+          arg = argc;
+        } else {
+          c->gendensity = pct;
+          arg += 2;
+        }
+      } else if (!strcmp(argv[arg] + 1, "seed")) {
+        unsigned long long sd;
+        char *rem;
+        if (arg + 1 >= argc ||
+            (sd = strtoull(argv[arg + 1], &rem, 10), *rem)) {
+          c->error = true;
+          fprintf(stderr, "%s: switch %s needs whole number argument\n",
+                  pname, argv[arg]);
+          arg = argc;
+        } else {
+          c->seed = sd;
+          c->seeded = true;
+          arg += 2;
+        }
+      } else if (!strcmp(argv[arg] + 1, "quantum")) {
+        unsigned nq;
+        char *rem;
+        if (arg + 1 >= argc ||
+            (nq = strtoul(argv[arg + 1], &rem, 10), *rem) ||
+            nq > QUANTUM_MAX) {
+          c->error = true;
+          fprintf(stderr, "%s: switch %s needs whole number argument\n",
+                  pname, argv[arg]);
+          arg = argc;
+        } else {
+          c->quantum = nq;
+          arg += 2;
+        }
+      } else if (!strcmp(argv[arg] + 1, "timeout")) {
+        unsigned long ms;
+        char *rem;
+        if (arg + 1 >= argc ||
+            (ms = strtoul(argv[arg + 1], &rem, 10), *rem)) {
+          c->error = true;
+          fprintf(stderr, "%s: switch %s needs whole number argument\n",
+                  pname, argv[arg]);
+          arg = argc;
+        } else {
+          c->timeout = ms;
+          arg += 2;
+        }
+      } else if (!strcmp(argv[arg] + 1, "maxsteps")) {
+        unsigned long long steps;
+        char *rem;
+        if (arg + 1 >= argc ||
+            (steps = strtoull(argv[arg + 1], &rem, 10), *rem)) {
+          c->error = true;
+          fprintf(stderr, "%s: switch %s needs whole number argument\n",
+                  pname, argv[arg]);
+          arg = argc;
+        } else {
+          c->maxsteps = steps;
+          arg += 2;
+        }
       } else if (!strcmp(argv[arg] + 1, "s")) {
         if (arg + 1 >= argc) {
           c->error = true;
@@ -975,6 +3038,7 @@ int parse_args(context *c, int argc, const char *argv[], const char *pname)
                   pname, argv[arg]);
           arg = argc;
         } else {
+          droppuzzle(c);
           c->ifile = argv[arg + 1];
 #ifdef OLDSWITCHES
           if (solve(c, pname) < 0)
@@ -990,6 +3054,86 @@ int parse_args(context *c, int argc, const char *argv[], const char *pname)
         if (solve(c, pname) < 0)
           return EXIT_FAILURE;
         arg++;
+      } else if (!strcmp(argv[arg] + 1, "xl")) {
+#ifndef NOAUTOEXEC
+        c->executed = true;
+#endif
+        if (solvelist(c, pname) < 0)
+          return EXIT_FAILURE;
+        arg++;
+      } else if (!strcmp(argv[arg] + 1, "xa")) {
+#ifndef NOAUTOEXEC
+        c->executed = true;
+#endif
+        if (solvestream(c, pname) < 0)
+          return EXIT_FAILURE;
+        arg++;
+      } else if (!strcmp(argv[arg] + 1, "decode")) {
+#ifndef NOAUTOEXEC
+        c->executed = true;
+#endif
+        if (decode(c, pname) < 0)
+          return EXIT_FAILURE;
+        arg++;
+      } else if (!strcmp(argv[arg] + 1, "extract")) {
+        unsigned long long k;
+        char *rem;
+#ifndef NOAUTOEXEC
+        c->executed = true;
+#endif
+        if (arg + 1 >= argc ||
+            (k = strtoull(argv[arg + 1], &rem, 10), *rem)) {
+          c->error = true;
+          fprintf(stderr, "%s: switch %s needs whole number argument\n",
+                  pname, argv[arg]);
+          arg = argc;
+        } else {
+          if (extract(c, pname, k) < 0)
+            return EXIT_FAILURE;
+          arg += 2;
+        }
+      } else if (!strcmp(argv[arg] + 1, "bench")) {
+#ifndef NOAUTOEXEC
+        c->executed = true;
+#endif
+        if (bench(c, pname) < 0)
+          return EXIT_FAILURE;
+        arg++;
+      } else if (!strcmp(argv[arg] + 1, "daemon")) {
+#ifndef NOAUTOEXEC
+        c->executed = true;
+#endif
+        if (arg + 1 >= argc) {
+          c->error = true;
+          fprintf(stderr, "%s: switch %s needs string argument\n",
+                  pname, argv[arg]);
+          arg = argc;
+        } else {
+          if (serve(c, argv[arg + 1], pname) < 0)
+            return EXIT_FAILURE;
+          arg += 2;
+        }
+      } else if (!strcmp(argv[arg] + 1, "batch")) {
+#ifndef NOAUTOEXEC
+        c->executed = true;
+#endif
+        if (arg + 1 >= argc) {
+          c->error = true;
+          fprintf(stderr, "%s: switch %s needs string argument\n",
+                  pname, argv[arg]);
+          arg = argc;
+        } else {
+          if (runbatch(c, argv[arg + 1], pname) < 0)
+            return EXIT_FAILURE;
+          arg += 2;
+        }
+      } else if (!strcmp(argv[arg] + 1, "enc")) {
+#ifndef NOAUTOEXEC
+        c->executed = false;
+#endif
+        droppuzzle(c);
+        c->encoded = true;
+        arg++;
       } else if (!strcmp(argv[arg] + 1, "penc")) {
 #ifndef NOAUTOEXEC
         c->executed = true;
@@ -997,6 +3141,23 @@ int parse_args(context *c, int argc, const char *argv[], const char *pname)
         if (encodepuzzle(c, pname) < 0)
           return EXIT_FAILURE;
         arg++;
+      } else if (!strcmp(argv[arg] + 1, "G")) {
+        unsigned long num;
+        char *rem;
+        if (arg + 1 >= argc ||
+            (num = strtoul(argv[arg + 1], &rem, 10), *rem)) {
+          c->error = true;
+          fprintf(stderr, "%s: switch %s needs whole number argument\n",
+                  pname, argv[arg]);
+          arg = argc;
+        } else {
+#ifndef NOAUTOEXEC
+          c->executed = true;
+#endif
+          if (generate(c, pname, num) < 0)
+            return EXIT_FAILURE;
+          arg += 2;
+        }
       } else if (!strcmp(argv[arg] + 1, "T")) {
 #ifndef NOAUTOEXEC
         c->executed = true;
@@ -1104,6 +3265,20 @@ int parse_args(context *c, int argc, const char *argv[], const char *pname)
           c->ofiletype = SINGLE;
           arg += 2;
         }
+      } else if (!strcmp(argv[arg] + 1, "oa")) {
+#ifndef NOAUTOEXEC
+        c->executed = false;
+#endif
+        if (arg + 1 >= argc) {
+          c->error = true;
+          fprintf(stderr, "%s: switch %s needs string argument\n",
+                  pname, argv[arg]);
+          arg = argc;
+        } else {
+          c->ofile = argv[arg + 1];
+          c->ofiletype = ARCHIVE;
+          arg += 2;
+        }
       } else if (!strcmp(argv[arg] + 1, "on")) {
 #ifndef NOAUTOEXEC
         c->executed = false;
@@ -1166,6 +3341,19 @@ int parse_args(context *c, int argc, const char *argv[], const char *pname)
             c->blank = argv[arg + 1];
           arg += 2;
         }
+      } else if (!strcmp(argv[arg] + 1, "unknown")) {
+#ifndef NOAUTOEXEC
+        c->executed = false;
+#endif
+        if (arg + 1 >= argc) {
+          c->error = true;
+          fprintf(stderr, "%s: switch %s needs string argument\n",
+                  pname, argv[arg]);
+          arg = argc;
+        } else {
+          c->unknown = argv[arg + 1];
+          arg += 2;
+        }
       } else {
         c->error = true;
         fprintf(stderr, "%s: unrecognised switch %s\n", pname, argv[arg]);
@@ -1184,15 +3372,55 @@ int parse_args(context *c, int argc, const char *argv[], const char *pname)
       } else if (!strcmp(argv[arg] + 1, "CE")) {
         c->countonerr = false;
         arg++;
+      } else if (!strcmp(argv[arg] + 1, "count")) {
+#ifndef NOAUTOEXEC
+        c->executed = false;
+#endif
+        c->countonly = false;
+        arg++;
       } else if (!strcmp(argv[arg] + 1, "s")) {
         c->limit = 0;
         arg++;
+      } else if (!strcmp(argv[arg] + 1, "timeout")) {
+        c->timeout = 0;
+        arg++;
+      } else if (!strcmp(argv[arg] + 1, "logbuf")) {
+        c->logbuf = 0;
+        arg++;
+      } else if (!strcmp(argv[arg] + 1, "maxsteps")) {
+        c->maxsteps = 0;
+        arg++;
+      } else if (!strcmp(argv[arg] + 1, "enc")) {
+#ifndef NOAUTOEXEC
+        c->executed = false;
+#endif
+        droppuzzle(c);
+        c->encoded = false;
+        arg++;
       } else if (!strcmp(argv[arg] + 1, "table")) {
 #ifndef NOAUTOEXEC
         c->executed = false;
 #endif
         c->table = false;
         arg++;
+      } else if (!strcmp(argv[arg] + 1, "bin")) {
+#ifndef NOAUTOEXEC
+        c->executed = false;
+#endif
+        c->binary = false;
+        arg++;
+      } else if (!strcmp(argv[arg] + 1, "hash")) {
+#ifndef NOAUTOEXEC
+        c->executed = false;
+#endif
+        c->hash = c->hashsort = false;
+        arg++;
+      } else if (!strcmp(argv[arg] + 1, "json")) {
+#ifndef NOAUTOEXEC
+        c->executed = false;
+#endif
+        c->json = false;
+        arg++;
       } else if (!strcmp(argv[arg] + 1, "v")) {
 #ifndef NOAUTOEXEC
         c->executed = false;
@@ -1223,6 +3451,35 @@ int parse_args(context *c, int argc, const char *argv[], const char *pname)
       } else if (!strcmp(argv[arg] + 1, "title")) {
         c->title = NULL;
         arg++;
+      } else if (!strcmp(argv[arg] + 1, "cache")) {
+        cache_close(c->cache);
+        c->cache = NULL;
+        c->cachefile = NULL;
+        arg++;
+      } else if (!strcmp(argv[arg] + 1, "stats")) {
+#ifndef NOAUTOEXEC
+        c->executed = false;
+#endif
+        c->statsfile = NULL;
+        arg++;
+      } else if (!strcmp(argv[arg] + 1, "trace")) {
+#ifndef NOAUTOEXEC
+        c->executed = false;
+#endif
+        c->tracefile = NULL;
+        arg++;
+      } else if (!strcmp(argv[arg] + 1, "checkpoint")) {
+#ifndef NOAUTOEXEC
+        c->executed = false;
+#endif
+        c->checkpointfile = NULL;
+        arg++;
+      } else if (!strcmp(argv[arg] + 1, "resume")) {
+#ifndef NOAUTOEXEC
+        c->executed = false;
+#endif
+        c->resume = false;
+        arg++;
       } else if (!strcmp(argv[arg] + 1, "dot")) {
 #ifndef NOAUTOEXEC
         c->executed = false;
@@ -1250,6 +3507,12 @@ int parse_args(context *c, int argc, const char *argv[], const char *pname)
         else
           c->blank = default_blank;
         arg += 2;
+      } else if (!strcmp(argv[arg] + 1, "unknown")) {
+#ifndef NOAUTOEXEC
+        c->executed = false;
+#endif
+        c->unknown = default_unknown;
+        arg++;
       } else {
         c->error = true;
         fprintf(stderr, "%s: unrecognised switch %s\n", pname, argv[arg]);
@@ -1272,77 +3535,69 @@ int parse_args(context *c, int argc, const char *argv[], const char *pname)
       return EXIT_FAILURE;
   }
 #endif
-  return EXIT_SUCCESS;
+  return c->expired ? EXIT_EXPIRED : EXIT_SUCCESS;
 }
 
+/* Load a grid with a row per line, stopping at the end, or after the
+   first line of a different length.  The input is scanned in place,
+   first to find the size, then to fill in the only allocation.  A
+   file is mapped whole and repositioned; other streams are read no
+   further than the grid. */
 nonogram_cell *loadgrid(size_t *width, size_t *height,
                           FILE *fp, char solid, char dot)
 {
-  struct line {
-    struct line *prev;
-    nonogram_cell *data;
-  };
-
-  char temp[300];
-  nonogram_cell *result;
-  size_t len, i;
-  struct line *bottom;
+  struct mapping m;
+  nonogram_cell map[UCHAR_MAX + 1], *result, *cell;
+  const char *p, *end, *first, *nl;
+  size_t len, row, col;
+  long pos;
 
   if (!width || !height) return NULL;
-  bottom = NULL;
   *width = 0;
   *height = 0;
 
-  while (fgets(temp, sizeof temp, fp)) {
-    struct line *next;
-
-    len = strlen(temp);
-    if (len > 0 && temp[len - 1] == '\n')
-      temp[--len] = '\0';
-
-    if (*width < 1) {
+  pos = ftell(fp);
+  if (map_rows(&m, fp) < 0)
+    return NULL;
+  p = m.base;
+  end = m.base + m.len;
+
+  /* leading empty lines are skipped */
+  while (p < end && *p == '\n')
+    p++;
+  first = p;
+
+  while (p < end) {
+    nl = memchr(p, '\n', end - p);
+    len = (nl ? nl : end) - p;
+    p = nl ? nl + 1 : end;
+    if (*height == 0)
       *width = len;
-    } else if (len != *width) {
-      goto finished;
-    }
-
-    next = malloc(sizeof(struct line));
-    if (!next)
-      goto failure;
-    next->data = malloc(*width * sizeof(nonogram_cell));
-    if (!next->data)
-      goto failure;
-    for (i = 0; i < *width; i++)
-      next->data[i] = temp[i] == dot ? nonogram_DOT :
-      (temp[i] == solid ? nonogram_SOLID : nonogram_BLANK);
-    next->prev = bottom;
-    bottom = next;
+    else if (len != *width)
+      break;
     (*height)++;
   }
 
-finished:
-  result = nonogram_makegrid(*width, *height);
-  if (!result)
-    goto failure;
+  /* Leave a file positioned as if read line by line. */
+  if (m.mapped && pos >= 0)
+    fseek(fp, pos + (long) (p - m.base), SEEK_SET);
 
-  for (i = *height; i > 0; ) {
-    struct line *prev = bottom->prev;
-    i--;
-    memcpy(result + i * *width, bottom->data, *width);
-    free(bottom->data);
-    free(bottom);
-    bottom = prev;
+  result = nonogram_makegrid(*width, *height);
+  if (!result) {
+    unmap_stream(&m);
+    return NULL;
   }
 
-  return result;
+  for (col = 0; col <= UCHAR_MAX; col++)
+    map[col] = nonogram_BLANK;
+  map[(unsigned char) solid] = nonogram_SOLID;
+  map[(unsigned char) dot] = nonogram_DOT;
 
-failure:
-  while (bottom) {
-    struct line *prev = bottom->prev;
-    free(bottom->data);
-    free(bottom);
-    bottom = prev;
-  }
+  cell = result;
+  for (p = first, row = 0; row < *height; row++, p++)
+    for (col = 0; col < *width; col++)
+      *cell++ = map[(unsigned char) *p++];
 
-  return NULL;
+  unmap_stream(&m);
+  return result;
 }
@@ -30,6 +30,11 @@
 
 #include <stdio.h>
 
+#include <nonogram.h>
+
+struct cache;
+struct gridlist;
+
 #ifndef false
 #define false 0
 #endif
@@ -37,7 +42,13 @@
 #define true 1
 #endif
 
-enum { MULTIPLE, SINGLE, STDSTREAM, NONE };
+enum { MULTIPLE, SINGLE, STDSTREAM, NONE, ARCHIVE };
+
+/* the largest -logbuf, in KiB */
+#define LOGBUF_MAX (1024 * 1024)
+
+/* the exit status when -timeout or -maxsteps cut a search short */
+#define EXIT_EXPIRED 3
 
 typedef struct {
   const char *html_dot;
@@ -46,19 +57,48 @@ typedef struct {
   const char *dot;
   const char *solid;
   const char *blank;
+  const char *unknown; /* cells of a partial grid */
   const char *ifile;
   const char *ofile;
+  FILE *in, *out; /* for -is and -os, or -ifd, -istr and -ofd */
+  FILE *stdinput, *stdoutput; /* what -is and -os return to */
+  int infd, outfd; /* from -ifd and -ofd, or -1 */
   const char *logfile;
+  const char *cachefile;
+  const char *statsfile;
+  const char *tracefile;
+  const char *checkpointfile;
+  struct cache *cache;
   const char *title;
+  nonogram_puzzle puzzle;
   int ofiletype;
   int limit;
   unsigned loglevel;
+  size_t logbuf;
+  unsigned threads;
+  int quantum;
+  unsigned long timeout;
+  unsigned long long maxsteps;
+  unsigned long genwidth, genheight;
+  unsigned gendensity;
+  unsigned long long seed;
   unsigned html : 1, table : 1, error : 1, executed : 1, visual : 1,
-    countonerr : 1, countonout : 1, algo : 4, verbose : 1, logappend : 1;
+    countonerr : 1, countonout : 1, algo : 4, verbose : 1, logappend : 1,
+    race : 1, countonly : 1, binary : 1, hash : 1, hashsort : 1,
+    json : 1, loaded : 1,
+    seeded : 1, expired : 1, resume : 1, ownin : 1, ownout : 1,
+    encoded : 1, job : 1, remote : 1;
 } context;
 
 int parse_args(context *c, int argc, const char *argv[], const char *pname);
 int print_context(context *p, FILE *fp);
 void init_context(context *p);
+void term_context(context *p);
+void droppuzzle(context *p);
+void releaseinput(context *p);
+void releaseoutput(context *p);
+int opencache(context *c);
+int keepsolutions(context *c, const nonogram_puzzle *puzzle,
+                  struct gridlist *keep, unsigned long long *count);
 
 #endif
@@ -21,7 +21,14 @@
  *  Contact Steven Simpson <https://github.com/simpsonst>
  */
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "display.h"
+#include "timing.h"
+#include "leword.h"
+
+static int addhash(struct h_tag *h, unsigned long long hash);
 
 #ifndef NOVISUAL
 #if defined(BBCGFX)
@@ -42,13 +49,9 @@ const struct nonogram_display our_display = {
   &colmark
 };
 
-const struct nonogram_client our_client = {
-  &print_it
-};
-
 int printgrid(const nonogram_cell *grid, size_t width, size_t height,
               FILE *fp, const char *solid, const char *dot,
-              const char *blank);
+              const char *blank, int gap, char **buf, size_t *cap);
 int printhtmlgrid(const nonogram_cell *grid, size_t width, size_t height,
                   FILE *fp, const char *solid, const char *dot,
                   const char *blank, int table);
@@ -119,6 +122,100 @@ void set_gcol(int c)
 }
 #endif
 
+#ifndef BBCGFX
+/* Set a character of the screen model, drawing it straight away if
+   there is no model. */
+static void put(struct h_tag *h, size_t x, size_t y, int ch)
+{
+  struct screen *s = &h->screen;
+
+  if (!s->want) {
+    move_to(x, y);
+    fputc(ch, stderr);
+    return;
+  }
+  if (x < s->cols && y < s->rows)
+    s->want[x + y * s->cols] = ch;
+}
+
+/* Send only the characters that differ from what is shown, if a frame
+   is due or forced. */
+void refresh_display(struct h_tag *h, int force)
+{
+  struct screen *s = &h->screen;
+  size_t x, y, cx = (size_t) -1, cy = (size_t) -1;
+  double now;
+
+  if (!s->want) {
+    fflush(stderr);
+    return;
+  }
+  now = monotime();
+  if (!force && now - s->last < 1.0 / SCREEN_RATE)
+    return;
+  s->last = now;
+
+  for (y = 0; y < s->rows; y++)
+    for (x = 0; x < s->cols; x++) {
+      size_t i = x + y * s->cols;
+      if (s->want[i] == s->shown[i])
+        continue;
+      if (x != cx || y != cy)
+        move_to(x, y);
+      fputc(s->want[i], stderr);
+      s->shown[i] = s->want[i];
+      cx = x + 1;
+      cy = y;
+    }
+  if (cy != (size_t) -1)
+    move_to(1, h->puzzle.height + 3);
+  fflush(stderr);
+}
+#else
+void refresh_display(struct h_tag *h, int force)
+{
+  fflush(stderr);
+}
+#endif
+
+void begin_display(struct h_tag *h)
+{
+#ifndef BBCGFX
+  struct screen *s = &h->screen;
+#endif
+
+  clear_screen();
+#ifdef BBCGFX
+  draw_grid(h->puzzle.width, h->puzzle.height);
+#else
+  s->cols = h->puzzle.width + 3;
+  s->rows = h->puzzle.height + 3;
+  s->want = malloc(s->cols * s->rows);
+  s->shown = malloc(s->cols * s->rows);
+  if (!s->want || !s->shown) {
+    free(s->want);
+    free(s->shown);
+    s->want = s->shown = NULL;
+    return;
+  }
+  /* what the cleared screen shows */
+  memset(s->want, ' ', s->cols * s->rows);
+  memset(s->shown, ' ', s->cols * s->rows);
+  s->last = monotime();
+#endif
+}
+
+void end_display(struct h_tag *h)
+{
+  refresh_display(h, true);
+  move_to(0, h->puzzle.height + 6);
+#ifndef BBCGFX
+  free(h->screen.want);
+  free(h->screen.shown);
+  h->screen.want = h->screen.shown = NULL;
+#endif
+}
+
 void drawarea(void *vh, const struct nonogram_rect *a)
 {
   struct h_tag *h = vh;
@@ -126,81 +223,79 @@ void drawarea(void *vh, const struct nonogram_rect *a)
 
   for (x = a->min.x; x < a->max.x; x++)
     for (y = a->min.y; y < a->max.y; y++) {
+#ifdef BBCGFX
       move_to(x, y);
       switch (h->grid[x + y * h->puzzle.width]) {
-#ifdef BBCGFX
       case nonogram_BLANK: set_gcol(BBCGFX_COL_BLANK); break;
       case nonogram_DOT: set_gcol(BBCGFX_COL_DOT); break;
       case nonogram_SOLID: set_gcol(BBCGFX_COL_SOLID); break;
       default: set_gcol(BBCGFX_COL_UNKNOWN); break;
-#else
-      case nonogram_BLANK: fputc(' ', stderr); break;
-      case nonogram_DOT: fputc('-', stderr); break;
-      case nonogram_SOLID: fputc('#', stderr); break;
-      default: fputc('?', stderr); break;
-#endif
       }
-#ifdef BBCGFX
       draw_block();
+#else
+      switch (h->grid[x + y * h->puzzle.width]) {
+      case nonogram_BLANK: put(h, x, y, ' '); break;
+      case nonogram_DOT: put(h, x, y, '-'); break;
+      case nonogram_SOLID: put(h, x, y, '#'); break;
+      default: put(h, x, y, '?'); break;
+      }
 #endif
     }
-  fflush(stderr);
+  refresh_display(h, false);
 }
 
 void rowfocus(void *vh, size_t r, int s)
 {
   struct h_tag *h = vh;
-  move_to(h->puzzle.width + 1, r);
 #ifdef BBCGFX
+  move_to(h->puzzle.width + 1, r);
   set_gcol(s ? (BBCGFX_COL_ACTIVE) : (BBCGFX_COL_BG));
   draw_block();
 #else
-  fputc(s ? '!' : ' ', stderr);
-  move_to(1, h->puzzle.height + 3);
+  put(h, h->puzzle.width + 1, r, s ? '!' : ' ');
 #endif
-  fflush(stderr);
+  refresh_display(h, false);
 }
 
 void colfocus(void *vh, size_t c, int s)
 {
   struct h_tag *h = vh;
-  move_to(c, h->puzzle.height + 1);
 #ifdef BBCGFX
+  move_to(c, h->puzzle.height + 1);
   set_gcol(s ? (BBCGFX_COL_ACTIVE) : (BBCGFX_COL_BG));
   draw_block();
 #else
-  fputc(s ? '!' : ' ', stderr);
-  move_to(1, h->puzzle.height + 3);
+  put(h, c, h->puzzle.height + 1, s ? '!' : ' ');
 #endif
-  fflush(stderr);
+  refresh_display(h, false);
 }
 
 void rowmark1(void *vh, size_t r, int s)
 {
   struct h_tag *h = vh;
-  move_to(h->puzzle.width + 2, r);
 #ifdef BBCGFX
+  move_to(h->puzzle.width + 2, r);
   set_gcol(s ? (s == 2 ? (BBCGFX_COL_NOTDONE) :
                 (BBCGFX_COL_HALFDONE)) : (BBCGFX_COL_BG));
   draw_block();
 #else
-  fputc(s + '0', stderr);
+  put(h, h->puzzle.width + 2, r, s + '0');
 #endif
-  fflush(stderr);
+  refresh_display(h, false);
 }
 
 void colmark1(void *vh, size_t c, int s)
 {
   struct h_tag *h = vh;
-  move_to(c, h->puzzle.height + 2);
 #ifdef BBCGFX
+  move_to(c, h->puzzle.height + 2);
   set_gcol(s ? (s == 2 ? (BBCGFX_COL_NOTDONE) :
                 (BBCGFX_COL_HALFDONE)) : (BBCGFX_COL_BG));
   draw_block();
 #else
-  fputc(s + '0', stderr);
+  put(h, c, h->puzzle.height + 2, s + '0');
 #endif
-  fflush(stderr);
+  refresh_display(h, false);
 }
 
 void rowmark(void *vh, size_t f, size_t t)
@@ -243,24 +338,100 @@ void draw_grid(int w, int h)
 
 #endif /* NOVISUAL */
 
+void gridlist_init(struct gridlist *l, size_t cells, size_t max)
+{
+  l->grids = NULL;
+  l->cells = cells;
+  l->n = l->cap = 0;
+  l->max = max;
+}
+
+int gridlist_add(struct gridlist *l, const nonogram_cell *g)
+{
+  if (l->max > 0 && l->n >= l->max)
+    return -1;
+  if (l->n == l->cap) {
+    size_t ncap = l->cap ? l->cap * 2 : 16;
+    nonogram_cell *ngrids;
+    if (l->max > 0 && ncap > l->max)
+      ncap = l->max;
+    ngrids = realloc(l->grids, ncap * l->cells * sizeof *ngrids);
+    if (!ngrids)
+      return -1;
+    l->grids = ngrids;
+    l->cap = ncap;
+  }
+  memcpy(l->grids + l->n++ * l->cells, g, l->cells * sizeof *g);
+  return 0;
+}
+
+void gridlist_term(struct gridlist *l)
+{
+  free(l->grids);
+}
+
+const struct nonogram_client our_client = {
+  &print_it
+};
+
+const struct nonogram_client our_counter = {
+  &count_it
+};
+
+const struct nonogram_client our_limited_counter = {
+  &count_to_limit
+};
+
+void count_it(void *vh)
+{
+  struct h_tag *h = vh;
+  h->solno++;
+}
+
+void count_to_limit(void *vh)
+{
+  struct h_tag *h = vh;
+  if (h->stop)
+    return;
+  if (++h->solno >= (unsigned) h->c->limit)
+    h->stop = true;
+}
+
 void print_it(void *vh)
 {
   struct h_tag *h = vh;
   FILE *fp;
   char fname[400];
+  double began = 0.0;
+  int whole;
 
+  /* The solver may run on past the limit within one quantum. */
+  if (h->stop)
+    return;
   h->solno++;
-  if (h->c->limit > 0 && h->solno >= h->c->limit)
+#ifndef NOVISUAL
+  if (h->c->visual)
+    refresh_display(h, true);
+#endif
+  if (h->c->limit > 0 && h->solno >= (unsigned) h->c->limit)
     h->stop = true;
+  /* A resumed search has already written these, except that sorted
+     hashes are only written at the end. */
+  if (h->solno <= h->skip) {
+    if (h->hashset)
+      addhash(h, gridhash(h->grid, h->puzzle.width, h->puzzle.height));
+    return;
+  }
+  if (h->keep)
+    gridlist_add(h->keep, h->grid);
 
+  if (h->c->statsfile)
+    began = monotime();
   switch (h->c->ofiletype) {
-  case STDSTREAM:
-    fp = stdout;
-    break;
   case NONE:
     return;
   case MULTIPLE:
-    sprintf(fname, h->c->ofile, h->solno);
+    sprintf(fname, h->c->ofile, (int) h->solno);
     fp = fopen(fname, "w");
     if (!fp) {
       if (h->c->visual)
@@ -269,15 +440,39 @@ void print_it(void *vh)
       return;
     }
     break;
+  case STDSTREAM:
   case SINGLE:
+  case ARCHIVE:
     fp = h->fp;
     break;
   default:
     fp = NULL;
     break;
   }
+  if (!fp)
+    return;
 
-  if (h->c->html) {
+  /* Each solution in an archive stands alone, as in its own file. */
+  whole = h->c->ofiletype == MULTIPLE || h->c->ofiletype == ARCHIVE;
+  if (h->c->ofiletype == ARCHIVE && archive_add(&h->arc, fp) < 0) {
+    fprintf(stderr, "solution %llu: can't add to archive\n", h->solno);
+    return;
+  }
+
+  if (h->hashset) {
+    if (addhash(h, gridhash(h->grid, h->puzzle.width,
+                            h->puzzle.height)) < 0)
+      fprintf(stderr, "solution %llu: no memory for its hash\n", h->solno);
+  } else if (h->c->hash) {
+    printhash(fp, gridhash(h->grid, h->puzzle.width, h->puzzle.height));
+  } else if (h->c->binary) {
+    if (whole)
+      printbinheader(fp, h->puzzle.width, h->puzzle.height);
+    printbingrid(h->grid, h->puzzle.width, h->puzzle.height, fp,
+                 &h->text, &h->textcap);
+    if (whole)
+      printbintrailer(fp, 1);
+  } else if (h->c->html) {
     printhtmlgrid(h->grid, h->puzzle.width, h->puzzle.height, fp,
                   h->c->html_solid, h->c->html_dot, h->c->html_blank,
                   h->c->table);
@@ -285,9 +480,8 @@ void print_it(void *vh)
             h->c->table ? h->puzzle.width : 1);
   } else {
     printgrid(h->grid, h->puzzle.width, h->puzzle.height, fp,
-              h->c->solid, h->c->dot, h->c->blank);
-    if (h->c->ofiletype != MULTIPLE)
-      fprintf(fp, "\n");
+              h->c->solid, h->c->dot, h->c->blank,
+              !whole, &h->text, &h->textcap);
   }
 
   switch (h->c->ofiletype) {
@@ -295,25 +489,313 @@ void print_it(void *vh)
     fclose(fp);
     break;
   }
+  if (h->c->statsfile)
+    h->stats.output += monotime() - began;
+}
+
+/* Write the grid as far as it was solved when the search ran out of
+   time or steps, with unknown cells shown by -unknown.  In a text or
+   HTML stream, it follows the solutions after a line saying so.  Files
+   per solution, archives, and binary and hash output can't hold it, so
+   it gets a file of its own, named as the output (or the next
+   solution's file) with ".partial" added. */
+void print_partial(struct h_tag *h)
+{
+  static const char suffix[] = ".partial";
+  FILE *fp;
+  char fname[420];
+  int own, len;
+
+  if (h->c->countonly || h->c->ofiletype == NONE)
+    return;
+  own = h->c->binary || h->c->hash ||
+    h->c->ofiletype == MULTIPLE || h->c->ofiletype == ARCHIVE;
+  if (own) {
+    switch (h->c->ofiletype) {
+    case MULTIPLE:
+      len = snprintf(fname, sizeof fname - (sizeof suffix - 1),
+                     h->c->ofile, (int) h->solno + 1);
+      break;
+    case SINGLE:
+    case ARCHIVE:
+      len = snprintf(fname, sizeof fname - (sizeof suffix - 1),
+                     "%s", h->c->ofile);
+      break;
+    default:
+      fprintf(stderr, "solution %llu: partial grid not written to"
+              " a binary or hash stream\n", h->solno + 1);
+      return;
+    }
+    /* Leave room for the suffix. */
+    if (len < 0 || (size_t) len >= sizeof fname - (sizeof suffix - 1)) {
+      fprintf(stderr, "solution %llu: partial grid file name too long\n",
+              h->solno + 1);
+      return;
+    }
+    strcpy(fname + len, suffix);
+    fp = fopen(fname, "w");
+    if (!fp) {
+      fprintf(stderr, "%s: can't write file\n", fname);
+      return;
+    }
+  } else {
+    fp = h->fp;
+    if (!fp)
+      return;
+  }
+
+  if (h->c->html) {
+    if (!own)
+      fprintf(fp, "<TR><TD COLSPAN=%zu>partial</TD></TR>\n",
+              h->c->table ? h->puzzle.width : 1);
+    printhtmlgrid(h->grid, h->puzzle.width, h->puzzle.height, fp,
+                  h->c->html_solid, h->c->html_dot, h->c->html_blank,
+                  h->c->table);
+    fprintf(fp, "<TR><TD COLSPAN=%zu><HR></TD></TR>\n",
+            h->c->table ? h->puzzle.width : 1);
+  } else {
+    if (!own)
+      fprintf(fp, "partial\n");
+    printgrid(h->grid, h->puzzle.width, h->puzzle.height, fp,
+              h->c->solid, h->c->dot, h->c->unknown,
+              !own, &h->text, &h->textcap);
+  }
+
+  if (own)
+    fclose(fp);
 }
 
+/* Render the whole grid into one buffer, and write it in one go.  If
+gap is set, a blank line follows. */
 int printgrid(const nonogram_cell *grid, size_t width, size_t height,
               FILE *fp, const char *solid, const char *dot,
-              const char *blank)
+              const char *blank, int gap, char **buf, size_t *cap)
 {
-  size_t row, col, count = 0;
+  size_t slen = strlen(solid), dlen = strlen(dot), blen = strlen(blank);
+  size_t most = slen > dlen ? slen : dlen;
+  size_t row, col, need;
+  char *p;
+
+  if (blen > most)
+    most = blen;
+  need = height * (width * most + 1) + 1;
+  if (need > *cap) {
+    char *nbuf = realloc(*buf, need);
+    if (!nbuf) {
+      /* fall back to writing a cell at a time */
+      for (row = 0; row < height; row++) {
+        for (col = 0; col < width; col++) {
+          int c = grid[col + row * width];
+          fputs(c == nonogram_SOLID ? solid :
+                c == nonogram_DOT ? dot : blank, fp);
+        }
+        putc('\n', fp);
+      }
+      if (gap)
+        putc('\n', fp);
+      return 0;
+    }
+    *buf = nbuf;
+    *cap = need;
+  }
 
-  for (row = 0; row < height; row++) {
-    for (col = 0; col < width; col++) {
-      int c = grid[col + row * width];
+  p = *buf;
+  if (slen == 1 && dlen == 1 && blen == 1) {
+    for (row = 0; row < height; row++) {
+      const nonogram_cell *line = grid + row * width;
+      for (col = 0; col < width; col++)
+        *p++ = line[col] == nonogram_SOLID ? *solid :
+          line[col] == nonogram_DOT ? *dot : *blank;
+      *p++ = '\n';
+    }
+  } else {
+    for (row = 0; row < height; row++) {
+      const nonogram_cell *line = grid + row * width;
+      for (col = 0; col < width; col++) {
+        switch (line[col]) {
+        case nonogram_SOLID:
+          memcpy(p, solid, slen);
+          p += slen;
+          break;
+        case nonogram_DOT:
+          memcpy(p, dot, dlen);
+          p += dlen;
+          break;
+        default:
+          memcpy(p, blank, blen);
+          p += blen;
+          break;
+        }
+      }
+      *p++ = '\n';
+    }
+  }
+  if (gap)
+    *p++ = '\n';
+
+  return fwrite(*buf, 1, p - *buf, fp);
+}
+
+/* Multi-byte fields are little-endian, so sets can be read on any
+   host. */
+int printbinheader(FILE *fp, size_t width, size_t height)
+{
+  unsigned char hdr[BINMAGICLEN + 8];
+
+  memcpy(hdr, BINMAGIC, BINMAGICLEN);
+  leword_put(hdr + BINMAGICLEN, width, 4);
+  leword_put(hdr + BINMAGICLEN + 4, height, 4);
+  return fwrite(hdr, 1, sizeof hdr, fp) == sizeof hdr ? 0 : -1;
+}
+
+/* Cells are packed in row order, most significant bit first, with 1
+   for solid and 0 for anything else. */
+int printbingrid(const nonogram_cell *grid, size_t width, size_t height,
+                 FILE *fp, char **buf, size_t *cap)
+{
+  size_t cells = width * height, need = 1 + (cells + 7) / 8, i;
+  unsigned char *p;
+
+  if (need > *cap) {
+    char *nbuf = realloc(*buf, need);
+    if (!nbuf)
+      return -1;
+    *buf = nbuf;
+    *cap = need;
+  }
+
+  p = (unsigned char *) *buf;
+  memset(p, 0, need);
+  p[0] = 1;
+  for (i = 0; i < cells; i++)
+    if (grid[i] == nonogram_SOLID)
+      p[1 + i / 8] |= 0x80 >> (i % 8);
+  return fwrite(p, 1, need, fp) == need ? 0 : -1;
+}
+
+int printbintrailer(FILE *fp, unsigned long long count)
+{
+  unsigned char tlr[9];
+
+  tlr[0] = 0;
+  leword_put(tlr + 1, count, 8);
+  return fwrite(tlr, 1, sizeof tlr, fp) == sizeof tlr ? 0 : -1;
+}
+
+/* Returns 0 on reading a header, 1 at the end of the input, and -1 on
+   error. */
+int scanbinheader(FILE *fp, size_t *width, size_t *height)
+{
+  unsigned char hdr[BINMAGICLEN + 8];
+  size_t got = fread(hdr, 1, sizeof hdr, fp);
+
+  if (got == 0 && feof(fp))
+    return 1;
+  if (got != sizeof hdr || memcmp(hdr, BINMAGIC, BINMAGICLEN))
+    return -1;
+  *width = leword_get(hdr + BINMAGICLEN, 4);
+  *height = leword_get(hdr + BINMAGICLEN + 4, 4);
+  return 0;
+}
+
+/* Returns 1 on reading a grid, 0 on reading the end of the set (with
+   its count), and -1 on error. */
+int scanbingrid(FILE *fp, nonogram_cell *grid, size_t width, size_t height,
+                unsigned long long *count)
+{
+  size_t cells = width * height, i;
+  unsigned char tlr[8];
+  int ch, bits = 0;
+
+  switch (ch = getc(fp)) {
+  case 0:
+    if (fread(tlr, 1, sizeof tlr, fp) != sizeof tlr)
+      return -1;
+    *count = leword_get(tlr, 8);
+    return 0;
+  case 1:
+    break;
+  default:
+    return -1;
+  }
 
-      count += fprintf(fp, "%s", c == nonogram_SOLID ? solid :
-                       c == nonogram_DOT ? dot : blank);
+  for (i = 0; i < cells; i++) {
+    if (i % 8 == 0 && (bits = getc(fp)) == EOF)
+      return -1;
+    grid[i] = (bits & (0x80 >> (i % 8))) ? nonogram_SOLID : nonogram_DOT;
+  }
+  return 1;
+}
+
+/* splitmix64's finaliser */
+static unsigned long long mixhash(unsigned long long z)
+{
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return (z ^ (z >> 31)) & 0xffffffffffffffffULL;
+}
+
+/* Cells are packed 64 to a word, 1 for solid, and each word is mixed
+   into the hash, which starts from the dimensions. */
+unsigned long long gridhash(const nonogram_cell *grid,
+                            size_t width, size_t height)
+{
+  size_t cells = width * height, i;
+  unsigned long long h = mixhash(width * 0x9e3779b97f4a7c15ULL ^ height);
+  unsigned long long w = 0;
+
+  for (i = 0; i < cells; i++) {
+    w = (w << 1) | (grid[i] == nonogram_SOLID);
+    if (i % 64 == 63 || i + 1 == cells) {
+      h = mixhash(h ^ w) + 0x9e3779b97f4a7c15ULL;
+      w = 0;
     }
-    putc('\n', fp);
-    count++;
   }
-  return count;
+  return h & 0xffffffffffffffffULL;
+}
+
+int printhash(FILE *fp, unsigned long long hash)
+{
+  return fprintf(fp, "%016llx\n", hash) < 0 ? -1 : 0;
+}
+
+/* Gather a hash for -hashsort. */
+static int addhash(struct h_tag *h, unsigned long long hash)
+{
+  if (h->nhashes == h->hashcap) {
+    size_t ncap = h->hashcap ? h->hashcap * 2 : 256;
+    unsigned long long *nh = realloc(h->hashes, ncap * sizeof *nh);
+    if (!nh)
+      return -1;
+    h->hashes = nh;
+    h->hashcap = ncap;
+  }
+  h->hashes[h->nhashes++] = hash;
+  return 0;
+}
+
+static int cmphash(const void *a, const void *b)
+{
+  unsigned long long x = *(const unsigned long long *) a;
+  unsigned long long y = *(const unsigned long long *) b;
+  return x < y ? -1 : x > y;
+}
+
+/* Write the hashes gathered for -hashsort in order, once each, and
+   forget them. */
+void print_hashes(struct h_tag *h)
+{
+  size_t i;
+
+  if (h->nhashes > 0) {
+    qsort(h->hashes, h->nhashes, sizeof *h->hashes, &cmphash);
+    for (i = 0; i < h->nhashes; i++)
+      if (i == 0 || h->hashes[i] != h->hashes[i - 1])
+        printhash(h->fp, h->hashes[i]);
+  }
+  free(h->hashes);
+  h->hashes = NULL;
+  h->nhashes = h->hashcap = 0;
 }
 
 int printhtmlgrid(const nonogram_cell *grid, size_t width, size_t height,
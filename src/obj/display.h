@@ -28,21 +28,111 @@
 
 #include "options.h"
 #include "context.h"
+#include "archive.h"
+
+/* a growing array of solution grids */
+struct gridlist {
+  nonogram_cell *grids;
+  size_t cells, n, cap, max;
+};
+
+void gridlist_init(struct gridlist *l, size_t cells, size_t max);
+int gridlist_add(struct gridlist *l, const nonogram_cell *g);
+void gridlist_term(struct gridlist *l);
+
+#ifndef NOVISUAL
+/* what the terminal shows, and what it should show; unused with
+   BBCGFX */
+struct screen {
+  char *want, *shown;
+  size_t cols, rows;
+  double last;
+};
+
+/* the most frames per second sent to the terminal */
+#define SCREEN_RATE 25
+#endif
+
+/* what -stats reports of a puzzle, times in seconds */
+struct stats {
+  double parse, load, solve, output;
+  unsigned long long steps, rowfocus, colfocus, cells;
+};
+
+/* an open -trace file, and the lines the solver is working on */
+struct trace {
+  FILE *fp;
+  double origin, rowsince, colsince;
+  size_t row, col;
+  unsigned inrow : 1, incol : 1;
+};
 
 struct h_tag {
   nonogram_puzzle puzzle;
   nonogram_cell *grid;
   nonogram_solver solver;
   context *c;
-  int solno;
-  unsigned stop : 1;
+  unsigned long long solno;
+  struct gridlist *keep;
+  char *text;
+  size_t textcap;
+  unsigned stop : 1, expired : 1, hashset : 1;
   FILE *fp, *logfp;
+  struct stats stats;
+  struct trace trace;
+
+  /* -checkpoint: the puzzle's key, the solutions already written by an
+     earlier run, and when to record progress next */
+  char *ckkey;
+  size_t ckkeylen;
+  unsigned long long skip;
+  double cknext;
+
+  /* -hashsort: the hashes to be written when the search ends */
+  unsigned long long *hashes;
+  size_t nhashes, hashcap;
+
+  /* -oa: where each solution starts */
+  struct archive arc;
+#ifndef NOVISUAL
+  struct screen screen;
+#endif
 };
 
+/* Binary solution sets: a header giving the dimensions, then each
+   grid preceded by a 1 byte and packed one bit per cell, then a 0
+   byte and the number of grids in the set. */
+#define BINMAGIC "NONOBIN1"
+#define BINMAGICLEN 8
+
+int printbinheader(FILE *fp, size_t width, size_t height);
+int printbingrid(const nonogram_cell *grid, size_t width, size_t height,
+                 FILE *fp, char **buf, size_t *cap);
+int printbintrailer(FILE *fp, unsigned long long count);
+int scanbinheader(FILE *fp, size_t *width, size_t *height);
+int scanbingrid(FILE *fp, nonogram_cell *grid, size_t width, size_t height,
+                unsigned long long *count);
+
+/* -hash: a 64-bit fingerprint of each solution, written in hex */
+unsigned long long gridhash(const nonogram_cell *grid,
+                            size_t width, size_t height);
+int printhash(FILE *fp, unsigned long long hash);
+
 void print_it(void *h);
+void print_partial(struct h_tag *h);
+void print_hashes(struct h_tag *h);
+void count_it(void *h);
+void count_to_limit(void *h);
+
+extern const struct nonogram_client our_client;
+extern const struct nonogram_client our_counter;
+extern const struct nonogram_client our_limited_counter;
 
 #ifndef NOVISUAL
 void clear_screen(void);
+void begin_display(struct h_tag *h);
+void refresh_display(struct h_tag *h, int force);
+void end_display(struct h_tag *h);
 void move_to(int x, int y);
 void drawarea(void *h, const struct nonogram_rect *a);
 void rowfocus(void *h, size_t r, int s);
@@ -51,7 +141,6 @@ void rowmark(void *h, size_t f, size_t t);
 void colmark(void *h, size_t f, size_t t);
 
 extern const struct nonogram_display our_display;
-extern const struct nonogram_client our_client;
 
 #ifdef BBCGFX
 void draw_grid(int w, int h);
@@ -0,0 +1,191 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ *  Nonogram - Terminal-based Nonogram solver
+ *  Copyright (C) 2001,2005-7,2012  Steven Simpson
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  Contact Steven Simpson <https://github.com/simpsonst>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "encoding.h"
+
+/* Copy a rule from a line of the text format, without spaces, and
+   with 0 for an empty line.  Nothing is written if fp is NULL. */
+static int printrule(FILE *fp, const char *line, size_t len)
+{
+  size_t i;
+  int digits = 0;
+
+  for (i = 0; i < len; i++) {
+    if (isdigit((unsigned char) line[i])) {
+      digits = 1;
+    } else if (line[i] == ' ' || line[i] == '\t') {
+      continue;
+    } else if (line[i] != ',') {
+      return -1;
+    }
+    if (fp)
+      putc(line[i], fp);
+  }
+  if (!digits && fp)
+    putc('0', fp);
+  return 0;
+}
+
+/* Copy the rules of the named section of the text format, separated
+   by full stops, returning how many there are, or -1 if one can't be
+   read. */
+static long printsection(FILE *fp, const char *text, size_t len,
+                         const char *name)
+{
+  const char *p, *end = text + len, *nl;
+  size_t llen;
+  long n = 0;
+  int in = 0;
+
+  for (p = text; p < end; p = nl + 1) {
+    nl = memchr(p, '\n', end - p);
+    if (!nl)
+      nl = end;
+    llen = nl - p;
+    while (llen > 0 && isspace((unsigned char) p[llen - 1]))
+      llen--;
+    if (!in) {
+      in = llen == strlen(name) && !memcmp(p, name, llen);
+      continue;
+    }
+    if (llen == 0)
+      break;
+    if (n++ > 0 && fp)
+      putc('.', fp);
+    if (printrule(fp, p, llen) < 0)
+      return -1;
+  }
+  return n;
+}
+
+int encoding_print(FILE *fp, const nonogram_puzzle *puzzle)
+{
+  char *text = NULL;
+  size_t len = 0;
+  FILE *mem;
+  int rc = 0;
+
+  /* The library only gives the rules out in its text format. */
+  if (!(mem = open_memstream(&text, &len)))
+    return -1;
+  if (nonogram_fprintpuzzle(puzzle, mem) < 0)
+    rc = -1;
+  if (fclose(mem) != 0 || rc < 0 ||
+      printsection(NULL, text, len, "rows") <= 0 ||
+      printsection(NULL, text, len, "columns") <= 0) {
+    free(text);
+    return -1;
+  }
+  printsection(fp, text, len, "rows");
+  putc('/', fp);
+  printsection(fp, text, len, "columns");
+  free(text);
+  return ferror(fp) ? -1 : 0;
+}
+
+/* Write one side of an encoding as lines of the text format,
+   returning -1 if it is bad. */
+static int writeside(FILE *fp, const char *p, const char *end)
+{
+  int digits = 0;
+
+  for (; p < end; p++) {
+    if (isdigit((unsigned char) *p)) {
+      putc(*p, fp);
+      digits = 1;
+    } else if (digits && (*p == ',' || *p == '.')) {
+      putc(*p == ',' ? ',' : '\n', fp);
+      digits = 0;
+    } else {
+      return -1;
+    }
+  }
+  if (!digits)
+    return -1;
+  putc('\n', fp);
+  return 0;
+}
+
+/* Count the lines of one side of an encoding. */
+static size_t countlines(const char *p, const char *end)
+{
+  size_t n = 1;
+
+  for (; p < end; p++)
+    if (*p == '.')
+      n++;
+  return n;
+}
+
+FILE *encoding_open(const char *code, size_t len)
+{
+  const char *end = code + len, *slash = memchr(code, '/', len);
+  char *text = NULL;
+  size_t textlen = 0;
+  FILE *mem, *fp;
+  int rc = 0;
+
+  if (!slash)
+    return NULL;
+  if (!(mem = open_memstream(&text, &textlen)))
+    return NULL;
+  fprintf(mem, "width %lu\nheight %lu\n\nrows\n",
+          (unsigned long) countlines(slash + 1, end),
+          (unsigned long) countlines(code, slash));
+  if (writeside(mem, code, slash) < 0)
+    rc = -1;
+  fprintf(mem, "\ncolumns\n");
+  if (writeside(mem, slash + 1, end) < 0)
+    rc = -1;
+  if (fclose(mem) != 0 || rc < 0) {
+    free(text);
+    return NULL;
+  }
+
+  /* The stream keeps its own copy, so the caller has only it to
+     close. */
+  fp = fmemopen(NULL, textlen, "w+");
+  if (fp && (fwrite(text, 1, textlen, fp) != textlen ||
+             fseek(fp, 0, SEEK_SET) != 0)) {
+    fclose(fp);
+    fp = NULL;
+  }
+  free(text);
+  return fp;
+}
+
+int encoding_read(nonogram_puzzle *puzzle, const char *code, size_t len)
+{
+  FILE *fp = encoding_open(code, len);
+  int rc;
+
+  if (!fp)
+    return -1;
+  rc = nonogram_fscanpuzzle(puzzle, fp);
+  fclose(fp);
+  return rc < 0 ? -1 : 0;
+}
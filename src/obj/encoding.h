@@ -0,0 +1,47 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ *  Nonogram - Terminal-based Nonogram solver
+ *  Copyright (C) 2001,2005-7,2012  Steven Simpson
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  Contact Steven Simpson <https://github.com/simpsonst>
+ */
+
+#ifndef ENCODING_HEADER
+#define ENCODING_HEADER
+
+#include <stdio.h>
+
+#include <nonogram.h>
+
+/* A puzzle's rules on one line, as -penc prints them and -enc reads
+   them: each row's rule as numbers separated by commas (0 for an
+   empty line), the rows separated by full stops, then a slash, then
+   the columns in the same way, e.g., "1.3.1/1.3.1" for a cross.  The
+   title and notes are not kept. */
+
+/* Write the encoding of a puzzle, without a line ending. */
+int encoding_print(FILE *fp, const nonogram_puzzle *puzzle);
+
+/* Open a stream holding an encoded puzzle in the text format, for
+   nonogram_fscanpuzzle(), or return NULL if the encoding is bad. */
+FILE *encoding_open(const char *code, size_t len);
+
+/* Decode a puzzle, returning -1 if the encoding is bad. */
+int encoding_read(nonogram_puzzle *puzzle, const char *code, size_t len);
+
+#endif
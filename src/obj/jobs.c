@@ -0,0 +1,565 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ *  Nonogram - Terminal-based Nonogram solver
+ *  Copyright (C) 2001,2005-7,2012  Steven Simpson
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  Contact Steven Simpson <https://github.com/simpsonst>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "options.h"
+
+#ifndef NOSOCKETS
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <sys/un.h>
+#endif
+
+#ifndef NOTHREADS
+#include <pthread.h>
+#endif
+
+#include "jobs.h"
+#include "pool.h"
+
+int splitargs(char *line, const char ***argv)
+{
+  const char **v = NULL, **nv;
+  size_t n = 0, cap = 0;
+  char *in = line, *out = line;
+  int quote;
+
+  for (;;) {
+    while (*in == ' ' || *in == '\t' || *in == '\r' || *in == '\n')
+      in++;
+    if (*in == '\0' || *in == '#')
+      break;
+
+    if (n + 1 >= cap) {
+      cap = cap ? cap * 2 : 16;
+      nv = realloc(v, cap * sizeof *v);
+      if (!nv) {
+        free(v);
+        return -1;
+      }
+      v = nv;
+    }
+    v[n++] = out;
+
+    /* Copy the argument down over its quotes. */
+    quote = 0;
+    while (*in != '\0') {
+      if (quote == '$') {
+        /* $'...' as in the shell, so that a job can carry an -istr
+           puzzle's line breaks */
+        if (*in == '\'') {
+          quote = 0;
+          in++;
+        } else if (*in == '\\' && in[1] != '\0') {
+          switch (in[1]) {
+          case 'n': *out++ = '\n'; break;
+          case 't': *out++ = '\t'; break;
+          case 'r': *out++ = '\r'; break;
+          default: *out++ = in[1]; break;
+          }
+          in += 2;
+        } else {
+          *out++ = *in++;
+        }
+      } else if (quote == '\'') {
+        if (*in == '\'')
+          quote = 0;
+        else
+          *out++ = *in;
+        in++;
+      } else if (*in == '\\' && in[1] != '\0' &&
+                 (!quote || in[1] == '"' || in[1] == '\\')) {
+        *out++ = in[1];
+        in += 2;
+      } else if (quote == '"') {
+        if (*in == '"')
+          quote = 0;
+        else
+          *out++ = *in;
+        in++;
+      } else if (*in == '$' && in[1] == '\'') {
+        quote = '$';
+        in += 2;
+      } else if (*in == '\'' || *in == '"') {
+        quote = *in++;
+      } else if (*in == ' ' || *in == '\t' || *in == '\r' ||
+                 *in == '\n') {
+        break;
+      } else {
+        *out++ = *in++;
+      }
+    }
+    if (quote) {
+      free(v);
+      return -1;
+    }
+    if (*in != '\0')
+      in++;
+    *out++ = '\0';
+  }
+
+  if (!v && !(v = malloc(sizeof *v)))
+    return -1;
+  v[n] = NULL;
+  *argv = v;
+  return n;
+}
+
+int runjob(const context *base, char *line, FILE *in, FILE *out,
+           const char *pname)
+{
+  context c = *base;
+  const char **argv;
+  int argc, rc;
+
+  argc = splitargs(line, &argv);
+  if (argc < 0) {
+    fprintf(stderr, "%s: unclosed quote in job\n", pname);
+    return EXIT_FAILURE;
+  }
+
+  /* A kept puzzle and any -ifd, -istr or -ofd streams belong to the
+     base, and the cache is shared with other jobs. */
+  c.job = true;
+  c.in = c.stdinput = in;
+  c.out = c.stdoutput = out;
+  c.infd = c.outfd = -1;
+  c.ownin = c.ownout = false;
+  c.loaded = false;
+  c.error = false;
+  c.expired = false;
+  c.executed = true;
+  rc = parse_args(&c, argc, argv, pname);
+  droppuzzle(&c);
+  releaseinput(&c);
+  releaseoutput(&c);
+  fflush(out);
+  free(argv);
+  return rc;
+}
+
+/* Answer requests until the input runs out.  Each answer is gathered
+   first, so that the line ending it can be put on a line of its
+   own. */
+static void answer(const context *c, FILE *in, FILE *out, const char *pname)
+{
+  char *line = NULL, *buf = NULL;
+  size_t cap = 0, len;
+  FILE *mem;
+  int rc;
+
+  while (getline(&line, &cap, in) >= 0) {
+    const char *p = line + strspn(line, " \t\r\n");
+
+    if (*p == '\0' || *p == '#')
+      continue;
+    if (!(mem = open_memstream(&buf, &len))) {
+      fprintf(out, "@ %d\n", EXIT_FAILURE);
+      break;
+    }
+    rc = runjob(c, line, in, mem, pname);
+    fclose(mem);
+    fwrite(buf, 1, len, out);
+    if (len > 0 && buf[len - 1] != '\n')
+      putc('\n', out);
+    free(buf);
+    buf = NULL;
+    fprintf(out, "@ %d\n", rc);
+    if (fflush(out) != 0)
+      break;
+  }
+  free(line);
+}
+
+#ifndef NOSOCKETS
+/* the most connections served at once; others wait to be accepted */
+#define DAEMON_MAXCONN 64
+
+struct conns {
+#ifndef NOTHREADS
+  pthread_mutex_t lock;
+  pthread_cond_t freed;
+#endif
+  unsigned n;
+};
+
+struct conn {
+  const context *c;
+  const char *pname;
+  struct conns *all;
+  int fd;
+};
+
+/* the signal that stops the daemon, or 0 */
+static volatile sig_atomic_t stopsig;
+
+static void stopserving(int sig)
+{
+  stopsig = sig;
+}
+
+/* Set the signal mask of the calling thread. */
+static void masksignals(int how, const sigset_t *set, sigset_t *old)
+{
+#ifdef NOTHREADS
+  sigprocmask(how, set, old);
+#else
+  pthread_sigmask(how, set, old);
+#endif
+}
+
+static void *serveconn(void *vp)
+{
+  struct conn *cn = vp;
+  struct conns *all = cn->all;
+  FILE *in, *out = NULL;
+  int fd2;
+
+  in = fdopen(cn->fd, "r");
+  if (in && (fd2 = dup(cn->fd)) >= 0 && !(out = fdopen(fd2, "w")))
+    close(fd2);
+  if (in && out)
+    answer(cn->c, in, out, cn->pname);
+  if (out)
+    fclose(out);
+  if (in)
+    fclose(in);
+  else
+    close(cn->fd);
+  free(cn);
+
+#ifndef NOTHREADS
+  pthread_mutex_lock(&all->lock);
+#endif
+  all->n--;
+#ifndef NOTHREADS
+  pthread_cond_signal(&all->freed);
+  pthread_mutex_unlock(&all->lock);
+#endif
+  return NULL;
+}
+#endif
+
+int serve(context *c, const char *path, const char *pname)
+{
+#ifndef NOSOCKETS
+  struct sockaddr_un addr;
+  struct sigaction sa, oldsa[3];
+  sigset_t stopset, oldmask, waitmask;
+  struct stat st;
+  struct conns all;
+  mode_t oldumask;
+  int sock;
+#endif
+
+  droppuzzle(c);
+  if (opencache(c) < 0)
+    return -1;
+
+  if (!strcmp(path, "-")) {
+    answer(c, c->in, c->out, pname);
+    return 0;
+  }
+
+#ifdef NOSOCKETS
+  fprintf(stderr, "%s: %s: sockets not supported\n", pname, path);
+  return -1;
+#else
+  if (strlen(path) >= sizeof addr.sun_path) {
+    fprintf(stderr, "%s: socket name too long\n", path);
+    return -1;
+  }
+  memset(&addr, 0, sizeof addr);
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  /* Replace the socket of an earlier run. */
+  if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    unlink(path);
+  /* Only the owner may connect, until the socket is given wider
+     permissions. */
+  sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  oldumask = umask(077);
+  if (sock < 0 ||
+      bind(sock, (struct sockaddr *) &addr, sizeof addr) < 0 ||
+      listen(sock, SOMAXCONN) < 0) {
+    fprintf(stderr, "%s: could not listen: %s\n", path, strerror(errno));
+    umask(oldumask);
+    if (sock >= 0)
+      close(sock);
+    return -1;
+  }
+  umask(oldumask);
+
+  /* A connection that goes away before it is accepted mustn't leave
+     accept() waiting for the next. */
+  fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+
+  /* A client that goes away shouldn't take the daemon with it.  The
+     signals that stop the daemon are blocked, except while waiting for
+     a connection, so that one arriving just before the wait still ends
+     it, and the socket can be removed.  Threads started to serve
+     connections inherit the blocking. */
+  signal(SIGPIPE, SIG_IGN);
+  stopsig = 0;
+  memset(&sa, 0, sizeof sa);
+  sa.sa_handler = &stopserving;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, &oldsa[0]);
+  sigaction(SIGTERM, &sa, &oldsa[1]);
+  sigaction(SIGHUP, &sa, &oldsa[2]);
+  sigemptyset(&stopset);
+  sigaddset(&stopset, SIGINT);
+  sigaddset(&stopset, SIGTERM);
+  sigaddset(&stopset, SIGHUP);
+  masksignals(SIG_BLOCK, &stopset, &oldmask);
+  waitmask = oldmask;
+  sigdelset(&waitmask, SIGINT);
+  sigdelset(&waitmask, SIGTERM);
+  sigdelset(&waitmask, SIGHUP);
+
+  /* Clients may not name files, as they may not be trusted with those
+     the daemon can reach. */
+  c->remote = true;
+  all.n = 0;
+#ifndef NOTHREADS
+  pthread_mutex_init(&all.lock, NULL);
+  pthread_cond_init(&all.freed, NULL);
+#endif
+  while (!stopsig) {
+    struct timespec pause;
+    struct conn *cn;
+    fd_set fds;
+    int fd, full = false;
+
+#ifndef NOTHREADS
+    pthread_mutex_lock(&all.lock);
+    full = all.n >= DAEMON_MAXCONN;
+    pthread_mutex_unlock(&all.lock);
+#endif
+
+    /* While full, look again for a free place every so often. */
+    FD_ZERO(&fds);
+    if (!full)
+      FD_SET(sock, &fds);
+    pause.tv_sec = 0;
+    pause.tv_nsec = 100000000;
+    if (pselect(full ? 0 : sock + 1, &fds, NULL, NULL,
+                full ? &pause : NULL, &waitmask) <= 0) {
+      if (full || errno == EINTR)
+        continue;
+      fprintf(stderr, "%s: could not wait: %s\n", path, strerror(errno));
+      break;
+    }
+    fd = accept(sock, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED ||
+          errno == EAGAIN || errno == EWOULDBLOCK)
+        continue;
+      fprintf(stderr, "%s: could not accept: %s\n", path, strerror(errno));
+      break;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    if (!(cn = malloc(sizeof *cn))) {
+      close(fd);
+      continue;
+    }
+    cn->c = c;
+    cn->pname = pname;
+    cn->all = &all;
+    cn->fd = fd;
+#ifndef NOTHREADS
+    pthread_mutex_lock(&all.lock);
+#endif
+    all.n++;
+#ifndef NOTHREADS
+    pthread_mutex_unlock(&all.lock);
+    {
+      pthread_t thread;
+
+      if (pthread_create(&thread, NULL, &serveconn, cn) == 0) {
+        pthread_detach(thread);
+        continue;
+      }
+    }
+#endif
+    /* Without threads, serve one client at a time, and let the stop
+       signals cut it short. */
+    masksignals(SIG_SETMASK, &waitmask, NULL);
+    serveconn(cn);
+    masksignals(SIG_BLOCK, &stopset, NULL);
+  }
+  close(sock);
+  unlink(path);
+  sigaction(SIGINT, &oldsa[0], NULL);
+  sigaction(SIGTERM, &oldsa[1], NULL);
+  sigaction(SIGHUP, &oldsa[2], NULL);
+
+  /* Die of the signal as before, now that the socket is gone. */
+  if (stopsig) {
+    signal(stopsig, SIG_DFL);
+    masksignals(SIG_SETMASK, &oldmask, NULL);
+    raise(stopsig);
+  }
+  masksignals(SIG_SETMASK, &oldmask, NULL);
+
+  /* Connections still being served use the context. */
+#ifndef NOTHREADS
+  pthread_mutex_lock(&all.lock);
+  while (all.n > 0)
+    pthread_cond_wait(&all.freed, &all.lock);
+  pthread_mutex_unlock(&all.lock);
+  pthread_cond_destroy(&all.freed);
+  pthread_mutex_destroy(&all.lock);
+#endif
+  c->remote = false;
+  return -1;
+#endif
+}
+
+struct batchjob {
+  char *line;
+  unsigned long lineno;
+  int rc;
+};
+
+struct batch {
+  const context *c;
+  const char *pname, *path;
+  FILE *empty;
+  unsigned failed : 1, expired : 1;
+};
+
+static void runbatchjob(void *vb, struct pool_job *j)
+{
+  struct batch *b = vb;
+  struct batchjob *job = j->data;
+
+  job->rc = runjob(b->c, job->line, b->empty, j->fp ? j->fp : b->c->out,
+                   b->pname);
+}
+
+static void endbatchjob(void *vb, struct pool_job *j)
+{
+  struct batch *b = vb;
+  struct batchjob *job = j->data;
+
+  if (j->failed) {
+    fprintf(stderr, "%s: %s:%lu: could not buffer output\n",
+            b->pname, b->path, job->lineno);
+    b->failed = true;
+  } else if (job->rc == EXIT_EXPIRED) {
+    b->expired = true;
+  } else if (job->rc != EXIT_SUCCESS) {
+    fprintf(stderr, "%s:%lu: job exited with status %d\n",
+            b->path, job->lineno, job->rc);
+    b->failed = true;
+  }
+  free(job->line);
+  free(job);
+}
+
+int runbatch(context *c, const char *path, const char *pname)
+{
+  struct batch b;
+  struct pool pool;
+  FILE *fin;
+  char *line = NULL;
+  size_t cap = 0;
+  unsigned long lineno = 0;
+  int rc = 0;
+
+  droppuzzle(c);
+  if (opencache(c) < 0)
+    return -1;
+  if (strcmp(path, "-")) {
+    fin = fopen(path, "r");
+    if (!fin) {
+      fprintf(stderr, "%s: could not read\n", path);
+      return -1;
+    }
+  } else {
+    fin = c->in;
+  }
+
+  /* As xargs does, keep jobs off the input, as they run at once. */
+  b.empty = fopen("/dev/null", "r");
+  if (!b.empty) {
+    fprintf(stderr, "%s: could not open empty input\n", pname);
+    if (fin != c->in)
+      fclose(fin);
+    return -1;
+  }
+  b.c = c;
+  b.pname = pname;
+  b.path = strcmp(path, "-") ? path : "stdin";
+  b.failed = b.expired = false;
+  if (pool_init(&pool, c->threads, c->out,
+                &runbatchjob, &endbatchjob, &b) < 0) {
+    fprintf(stderr, "%s: could not start workers\n", pname);
+    fclose(b.empty);
+    if (fin != c->in)
+      fclose(fin);
+    return -1;
+  }
+
+  while (getline(&line, &cap, fin) >= 0) {
+    const char *p = line + strspn(line, " \t\r\n");
+    struct batchjob *job;
+
+    lineno++;
+    if (*p == '\0' || *p == '#')
+      continue;
+    if (!(job = malloc(sizeof *job)) || !(job->line = strdup(line))) {
+      free(job);
+      fprintf(stderr, "%s: out of memory\n", pname);
+      rc = -1;
+      break;
+    }
+    job->lineno = lineno;
+    if (pool_submit(&pool, job) < 0) {
+      free(job->line);
+      free(job);
+      fprintf(stderr, "%s: out of memory\n", pname);
+      rc = -1;
+      break;
+    }
+  }
+  pool_term(&pool);
+  free(line);
+
+  fclose(b.empty);
+  if (fin != c->in)
+    fclose(fin);
+  if (b.expired)
+    c->expired = true;
+  return b.failed ? -1 : rc;
+}
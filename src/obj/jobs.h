@@ -0,0 +1,56 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ *  Nonogram - Terminal-based Nonogram solver
+ *  Copyright (C) 2001,2005-7,2012  Steven Simpson
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  Contact Steven Simpson <https://github.com/simpsonst>
+ */
+
+#ifndef JOBS_HEADER
+#define JOBS_HEADER
+
+#include <stdio.h>
+
+#include "context.h"
+
+/* Split a line into arguments in place, at spaces and tabs, with
+   '...', "...", $'...' (with \n, \t and \r) and backslash quoting,
+   and ignoring anything from an unquoted # that starts an argument.
+   *argv is set to an array to be freed.  Returns the number of
+   arguments, or -1 on an unclosed quote or lack of memory. */
+int splitargs(char *line, const char ***argv);
+
+/* Process a line of switches on a copy of base, as if it were a
+   command line, with in and out as the standard input and output.
+   Returns the exit status of such a command. */
+int runjob(const context *base, char *line, FILE *in, FILE *out,
+           const char *pname);
+
+/* Answer requests of a line of switches each, read from the standard
+   input if path is "-", or from each connection to a Unix-domain
+   socket created at path.  A puzzle a request reads from its input
+   follows the line.  Each answer is sent when complete, ending with a
+   line of @ and the exit status. */
+int serve(context *c, const char *path, const char *pname);
+
+/* Run each line of switches read from path ("-" for the standard
+   input) as a job, on -threads workers, writing their standard output
+   in the order listed.  Jobs read an empty standard input. */
+int runbatch(context *c, const char *path, const char *pname);
+
+#endif
@@ -0,0 +1,58 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ *  Nonogram - Terminal-based Nonogram solver
+ *  Copyright (C) 2001,2005-7,2012  Steven Simpson
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  Contact Steven Simpson <https://github.com/simpsonst>
+ */
+
+#include "json.h"
+
+int fprintjsonstr(FILE *fp, const char *s)
+{
+  int count = 0;
+
+  putc('"', fp);
+  count++;
+  for (; *s; s++) {
+    unsigned char ch = *s;
+    switch (ch) {
+    case '"':
+    case '\\':
+      count += fprintf(fp, "\\%c", ch);
+      break;
+    case '\n':
+      count += fprintf(fp, "\\n");
+      break;
+    case '\t':
+      count += fprintf(fp, "\\t");
+      break;
+    default:
+      if (ch < 0x20) {
+        count += fprintf(fp, "\\u%04x", ch);
+      } else {
+        putc(ch, fp);
+        count++;
+      }
+      break;
+    }
+  }
+  putc('"', fp);
+  count++;
+  return count;
+}
@@ -0,0 +1,155 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ *  Nonogram - Terminal-based Nonogram solver
+ *  Copyright (C) 2001,2005-7,2012  Steven Simpson
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  Contact Steven Simpson <https://github.com/simpsonst>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef NOMMAP
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+#include "context.h"
+#include "mapping.h"
+
+static int map_file(struct mapping *m, FILE *fp)
+{
+#ifndef NOMMAP
+  struct stat st;
+  long pos = ftell(fp);
+
+  if (pos >= 0 && fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode) &&
+      st.st_size > pos) {
+    void *start = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+                       fileno(fp), 0);
+    if (start != MAP_FAILED) {
+      m->start = start;
+      m->maplen = st.st_size;
+      m->base = (const char *) start + pos;
+      m->len = st.st_size - pos;
+      m->mapped = true;
+      fseek(fp, 0, SEEK_END);
+      return 0;
+    }
+  }
+#endif
+  return -1;
+}
+
+static int grow(struct mapping *m, size_t *cap)
+{
+  char *nbuf;
+
+  *cap = *cap ? *cap * 2 : 65536;
+  nbuf = realloc(m->start, *cap);
+  if (!nbuf) {
+    free(m->start);
+    return -1;
+  }
+  m->start = nbuf;
+  return 0;
+}
+
+static void finish(struct mapping *m, size_t cap)
+{
+  m->maplen = cap;
+  m->base = m->start;
+  m->mapped = false;
+}
+
+int map_stream(struct mapping *m, FILE *fp)
+{
+  size_t cap = 0, got;
+
+  if (map_file(m, fp) == 0)
+    return 0;
+
+  /* not a file, or it can't be mapped, so read it all */
+  m->start = NULL;
+  m->len = 0;
+  do {
+    if (m->len == cap && grow(m, &cap) < 0)
+      return -1;
+    got = fread((char *) m->start + m->len, 1, cap - m->len, fp);
+    m->len += got;
+  } while (got > 0);
+  if (ferror(fp)) {
+    free(m->start);
+    return -1;
+  }
+  finish(m, cap);
+  return 0;
+}
+
+int map_rows(struct mapping *m, FILE *fp)
+{
+  size_t cap = 0, line = 0, width = 0, len;
+  int rows = 0;
+  char *buf;
+
+  if (map_file(m, fp) == 0)
+    return 0;
+
+  /* Read only up to the line that ends the grid, so that whatever
+     follows is left in the stream. */
+  m->start = NULL;
+  m->len = 0;
+  for (;;) {
+    if (cap - m->len < 2 && grow(m, &cap) < 0)
+      return -1;
+    buf = m->start;
+    if (!fgets(buf + m->len, cap - m->len, fp))
+      break;
+    m->len += strlen(buf + m->len);
+    if ((m->len == line || buf[m->len - 1] != '\n') && !feof(fp))
+      continue;
+
+    /* a whole line is in; leading empty ones don't count */
+    len = m->len - line - (m->len > line && buf[m->len - 1] == '\n');
+    line = m->len;
+    if (rows == 0 && len == 0)
+      continue;
+    if (rows++ == 0)
+      width = len;
+    else if (len != width)
+      break;
+  }
+  if (ferror(fp)) {
+    free(m->start);
+    return -1;
+  }
+  finish(m, cap);
+  return 0;
+}
+
+void unmap_stream(struct mapping *m)
+{
+#ifndef NOMMAP
+  if (m->mapped) {
+    munmap(m->start, m->maplen);
+    return;
+  }
+#endif
+  free(m->start);
+}
@@ -0,0 +1,48 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ *  Nonogram - Terminal-based Nonogram solver
+ *  Copyright (C) 2001,2005-7,2012  Steven Simpson
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  Contact Steven Simpson <https://github.com/simpsonst>
+ */
+
+#ifndef MAPPING_HEADER
+#define MAPPING_HEADER
+
+#include <stdio.h>
+
+#include "options.h"
+
+/* the unread remainder of a stream, mapped into memory if it is a
+   regular file, or read into a buffer otherwise */
+struct mapping {
+  const char *base;
+  size_t len;
+  void *start;
+  size_t maplen;
+  unsigned mapped : 1;
+};
+
+int map_stream(struct mapping *m, FILE *fp);
+
+/* the same for a regular file, but from anything else, read only up
+   to the line that ends a -g grid */
+int map_rows(struct mapping *m, FILE *fp);
+void unmap_stream(struct mapping *m);
+
+#endif
@@ -0,0 +1,238 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ *  Nonogram - Terminal-based Nonogram solver
+ *  Copyright (C) 2001,2005-7,2012  Steven Simpson
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  Contact Steven Simpson <https://github.com/simpsonst>
+ */
+
+#include <string.h>
+
+#include "monitor.h"
+#include "json.h"
+#include "timing.h"
+
+/* trace threads, so that rows and columns get a track each */
+#define TRACE_PHASES 0
+#define TRACE_ROWS 1
+#define TRACE_COLS 2
+
+/* Write a complete event, lasting from one time to another. */
+static void traceline(struct trace *t, int tid, const char *kind,
+                      size_t line, double began, double ended)
+{
+  fprintf(t->fp, ",\n{\"name\":\"%s %zu\",\"cat\":\"%s\",\"ph\":\"X\","
+          "\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+          kind, line, kind, tid, (began - t->origin) * 1e6,
+          (ended - began) * 1e6);
+}
+
+/* Write an instant event on a line solver's track. */
+static void tracemark(struct trace *t, int tid, const char *name,
+                      const char *args)
+{
+  fprintf(t->fp, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\","
+          "\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"args\":{%s}}",
+          name, tid, (monotime() - t->origin) * 1e6, args);
+}
+
+static void monitor_drawarea(void *vh, const struct nonogram_rect *a)
+{
+  struct h_tag *h = vh;
+
+  h->stats.cells += (a->max.x - a->min.x) * (a->max.y - a->min.y);
+  if (h->trace.fp) {
+    char args[120];
+
+    sprintf(args, "\"x\":%d,\"y\":%d,\"w\":%d,\"h\":%d",
+            (int) a->min.x, (int) a->min.y,
+            (int) (a->max.x - a->min.x), (int) (a->max.y - a->min.y));
+    tracemark(&h->trace, h->trace.incol ? TRACE_COLS : TRACE_ROWS,
+              "drawarea", args);
+  }
+#ifndef NOVISUAL
+  if (h->c->visual)
+    drawarea(h, a);
+#endif
+}
+
+static void monitor_rowfocus(void *vh, size_t r, int s)
+{
+  struct h_tag *h = vh;
+
+  if (s)
+    h->stats.rowfocus++;
+  if (h->trace.fp) {
+    double now = monotime();
+
+    /* Close the previous row even if no loss of focus was reported. */
+    if (h->trace.inrow)
+      traceline(&h->trace, TRACE_ROWS, "row", h->trace.row,
+                h->trace.rowsince, now);
+    h->trace.inrow = s != 0;
+    h->trace.row = r;
+    h->trace.rowsince = now;
+  }
+#ifndef NOVISUAL
+  if (h->c->visual)
+    rowfocus(h, r, s);
+#endif
+}
+
+static void monitor_colfocus(void *vh, size_t c, int s)
+{
+  struct h_tag *h = vh;
+
+  if (s)
+    h->stats.colfocus++;
+  if (h->trace.fp) {
+    double now = monotime();
+
+    if (h->trace.incol)
+      traceline(&h->trace, TRACE_COLS, "col", h->trace.col,
+                h->trace.colsince, now);
+    h->trace.incol = s != 0;
+    h->trace.col = c;
+    h->trace.colsince = now;
+  }
+#ifndef NOVISUAL
+  if (h->c->visual)
+    colfocus(h, c, s);
+#endif
+}
+
+static void monitor_rowmark(void *vh, size_t f, size_t t)
+{
+  struct h_tag *h = vh;
+
+  if (h->trace.fp) {
+    char args[60];
+
+    sprintf(args, "\"from\":%zu,\"to\":%zu", f, t);
+    tracemark(&h->trace, TRACE_ROWS, "rowmark", args);
+  }
+#ifndef NOVISUAL
+  if (h->c->visual)
+    rowmark(h, f, t);
+#endif
+}
+
+static void monitor_colmark(void *vh, size_t f, size_t t)
+{
+  struct h_tag *h = vh;
+
+  if (h->trace.fp) {
+    char args[60];
+
+    sprintf(args, "\"from\":%zu,\"to\":%zu", f, t);
+    tracemark(&h->trace, TRACE_COLS, "colmark", args);
+  }
+#ifndef NOVISUAL
+  if (h->c->visual)
+    colmark(h, f, t);
+#endif
+}
+
+const struct nonogram_display monitor_display = {
+  &monitor_drawarea,
+  &monitor_rowfocus,
+  &monitor_colfocus,
+  &monitor_rowmark,
+  &monitor_colmark
+};
+
+void clearstats(struct stats *s)
+{
+  memset(s, 0, sizeof *s);
+}
+
+/* Write one JSON record, with times in seconds. */
+int printstats(FILE *fp, const char *name, size_t width, size_t height,
+               unsigned long long solutions, const struct stats *s)
+{
+  int count = 0;
+
+  count += fprintf(fp, "{\"puzzle\":");
+  count += fprintjsonstr(fp, name);
+  count += fprintf(fp, ",\"width\":%zu,\"height\":%zu,"
+                   "\"parse\":%.6f,\"load\":%.6f,\"solve\":%.6f,"
+                   "\"output\":%.6f,\"steps\":%llu,\"rowfocus\":%llu,"
+                   "\"colfocus\":%llu,\"cells\":%llu,\"solutions\":%llu}\n",
+                   width, height, s->parse, s->load, s->solve, s->output,
+                   s->steps, s->rowfocus, s->colfocus, s->cells, solutions);
+  return count;
+}
+
+/* Open a trace file, and name the process and tracks after the
+   puzzle. */
+int begintrace(struct h_tag *h, const char *file, const char *name)
+{
+  struct trace *t = &h->trace;
+
+  t->fp = fopen(file, "w");
+  if (!t->fp) {
+    fprintf(stderr, "%s: could not open\n", file);
+    return -1;
+  }
+  t->origin = monotime();
+  t->inrow = t->incol = false;
+  fprintf(t->fp, "{\"traceEvents\":[\n"
+          "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+          "\"args\":{\"name\":");
+  fprintjsonstr(t->fp, name);
+  fprintf(t->fp, "}}");
+  fprintf(t->fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+          "\"tid\":%d,\"args\":{\"name\":\"phases\"}}", TRACE_PHASES);
+  fprintf(t->fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+          "\"tid\":%d,\"args\":{\"name\":\"rows\"}}", TRACE_ROWS);
+  fprintf(t->fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+          "\"tid\":%d,\"args\":{\"name\":\"columns\"}}", TRACE_COLS);
+  return 0;
+}
+
+/* Record a phase of the solve, such as loading or searching. */
+void tracephase(struct h_tag *h, const char *name,
+                double began, double ended)
+{
+  struct trace *t = &h->trace;
+
+  if (!t->fp)
+    return;
+  fprintf(t->fp, ",\n{\"name\":\"%s\",\"cat\":\"phase\",\"ph\":\"X\","
+          "\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+          name, TRACE_PHASES, (began - t->origin) * 1e6,
+          (ended - began) * 1e6);
+}
+
+/* Close any line still in focus, and finish the file. */
+void endtrace(struct h_tag *h)
+{
+  struct trace *t = &h->trace;
+  double now;
+
+  if (!t->fp)
+    return;
+  now = monotime();
+  if (t->inrow)
+    traceline(t, TRACE_ROWS, "row", t->row, t->rowsince, now);
+  if (t->incol)
+    traceline(t, TRACE_COLS, "col", t->col, t->colsince, now);
+  fprintf(t->fp, "\n]}\n");
+  fclose(t->fp);
+  t->fp = NULL;
+}
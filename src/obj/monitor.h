@@ -0,0 +1,48 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ *  Nonogram - Terminal-based Nonogram solver
+ *  Copyright (C) 2001,2005-7,2012  Steven Simpson
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  Contact Steven Simpson <https://github.com/simpsonst>
+ */
+
+#ifndef MONITOR_HEADER
+#define MONITOR_HEADER
+
+#include <stdio.h>
+
+#include <nonogram.h>
+
+#include "display.h"
+
+/* A display that watches the solver for -stats and -trace, and
+   passes each event on to the visual display if -v is in use. */
+extern const struct nonogram_display monitor_display;
+
+void clearstats(struct stats *s);
+int printstats(FILE *fp, const char *name, size_t width, size_t height,
+               unsigned long long solutions, const struct stats *s);
+
+/* Chrome trace-event output of the display events, with timestamps in
+   microseconds from begintrace */
+int begintrace(struct h_tag *h, const char *file, const char *name);
+void tracephase(struct h_tag *h, const char *name,
+                double began, double ended);
+void endtrace(struct h_tag *h);
+
+#endif
@@ -0,0 +1,138 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ *  Nonogram - Terminal-based Nonogram solver
+ *  Copyright (C) 2001,2005-7,2012  Steven Simpson
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  Contact Steven Simpson <https://github.com/simpsonst>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "nonofront.h"
+#include "context.h"
+#include "display.h"
+#include "jobs.h"
+
+void nonofront_initopts(struct nonofront_opts *o)
+{
+  context c;
+
+  init_context(&c);
+  o->algo = c.algo;
+  o->race = false;
+  o->limit = 0;
+  o->timeout = 0;
+  o->maxsteps = 0;
+  o->quantum = 0;
+  term_context(&c);
+}
+
+/* Open a stream on memory, which may be empty. */
+static FILE *openmem(const char *buf, size_t len)
+{
+  if (len == 0)
+    return fopen("/dev/null", "r");
+  return fmemopen((void *) buf, len, "r");
+}
+
+int nonofront_solve(const char *puzzle, size_t len,
+                    const struct nonofront_opts *o,
+                    struct nonofront_result *r)
+{
+  context c;
+  nonogram_puzzle p;
+  struct gridlist keep;
+  FILE *fin;
+  int rc;
+
+  r->grids = NULL;
+  r->count = 0;
+  if (!(fin = openmem(puzzle, len)))
+    return -1;
+  rc = nonogram_fscanpuzzle(&p, fin);
+  fclose(fin);
+  if (rc < 0)
+    return -1;
+
+  init_context(&c);
+  c.ofiletype = NONE;
+  c.verbose = false;
+  c.algo = o->algo;
+  c.race = o->race;
+  c.limit = o->limit > INT_MAX ? INT_MAX : (int) o->limit;
+  c.timeout = o->timeout;
+  c.maxsteps = o->maxsteps;
+  c.quantum = o->quantum;
+
+  r->width = nonogram_puzzlewidth(&p);
+  r->height = nonogram_puzzleheight(&p);
+  gridlist_init(&keep, r->width * r->height, 0);
+  rc = keepsolutions(&c, &p, &keep, &r->count);
+  nonogram_freepuzzle(&p);
+  term_context(&c);
+  if (rc < 0) {
+    gridlist_term(&keep);
+    return -1;
+  }
+
+  /* Solutions that couldn't be kept are not counted. */
+  if (keep.n < r->count)
+    r->count = keep.n;
+  r->grids = keep.grids;
+  return rc;
+}
+
+void nonofront_freeresult(struct nonofront_result *r)
+{
+  free(r->grids);
+  r->grids = NULL;
+}
+
+int nonofront_run(const char *args, const char *in, size_t inlen,
+                  char **out, size_t *outlen)
+{
+  context c;
+  FILE *fin, *fout;
+  char *line;
+  int rc;
+
+  *out = NULL;
+  *outlen = 0;
+  if (!(line = strdup(args)))
+    return EXIT_FAILURE;
+  if (!(fin = openmem(in, inlen))) {
+    free(line);
+    return EXIT_FAILURE;
+  }
+  if (!(fout = open_memstream(out, outlen))) {
+    fclose(fin);
+    free(line);
+    return EXIT_FAILURE;
+  }
+
+  init_context(&c);
+  rc = runjob(&c, line, fin, fout, "nonofront");
+  term_context(&c);
+  fclose(fout);
+  fclose(fin);
+  free(line);
+  return rc;
+}
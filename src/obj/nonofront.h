@@ -0,0 +1,97 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ *  Nonogram - Terminal-based Nonogram solver
+ *  Copyright (C) 2001,2005-7,2012  Steven Simpson
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  Contact Steven Simpson <https://github.com/simpsonst>
+ */
+
+#ifndef NONOFRONT_HEADER
+#define NONOFRONT_HEADER
+
+#include <stddef.h>
+
+#include <nonogram.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The nonogram command's front end, for use in other programs.  Each
+   call sets up its own state, so calls may be made from several
+   threads at once.  Errors are still reported on the standard error
+   output. */
+
+/* The shared library is built with hidden visibility, so its
+   interface is marked for export. */
+#if defined(__GNUC__) && __GNUC__ >= 4
+#define NONOFRONT_API __attribute__((visibility("default")))
+#else
+#define NONOFRONT_API
+#endif
+
+struct nonofront_opts {
+  int algo;                     /* a nonogram_A* line solver */
+  unsigned race : 1;            /* or race several at once */
+  unsigned long long limit;     /* stop after this many solutions */
+  unsigned long timeout;        /* stop after this many ms */
+  unsigned long long maxsteps;  /* stop after this many solver steps */
+  int quantum;                  /* steps per call to the solver */
+};
+
+struct nonofront_result {
+  size_t width, height;
+  unsigned long long count;
+  nonogram_cell *grids;         /* count grids of width * height cells */
+};
+
+/* Set the defaults of the command: the fast comprehensive line solver,
+   and no limits. */
+NONOFRONT_API
+void nonofront_initopts(struct nonofront_opts *o);
+
+/* Solve a puzzle in the nonolib text format held in memory, returning
+   every solution found.  Returns 0 on success, 1 if a time or step
+   limit cut the search short, or -1 on error.  Free the result with
+   nonofront_freeresult. */
+NONOFRONT_API
+int nonofront_solve(const char *puzzle, size_t len,
+                    const struct nonofront_opts *o,
+                    struct nonofront_result *r);
+
+NONOFRONT_API
+void nonofront_freeresult(struct nonofront_result *r);
+
+/* Process a line of switches as the command would, reading its
+   standard input from in, and leaving its standard output in *out
+   (to be freed) and its length in *outlen.  This reaches most
+   actions, e.g., "-g" to make a puzzle from a grid, "-j" to judge one,
+   or "-c" to verify it.  The line is run as a -batch job, so switches
+   that would reach beyond the call (-ifd, -ofd, -v, -cache, +cache,
+   -daemon and -batch) are refused.  Files named by the line are the
+   caller's to keep apart between threads.  Returns the command's exit
+   status. */
+NONOFRONT_API
+int nonofront_run(const char *args, const char *in, size_t inlen,
+                  char **out, size_t *outlen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
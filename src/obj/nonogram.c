@@ -46,7 +46,9 @@ int main(int argc, const char *argv[])
   int r;
 
   init_context(&ctx);
-  if ((r = parse_args(&ctx, argc - 1, argv + 1, argv[0])) != 0) {
+  r = parse_args(&ctx, argc - 1, argv + 1, argv[0]);
+  term_context(&ctx);
+  if (r != 0) {
     /* print_usage(stderr, argv[0]); */
     exit(r);
   }
@@ -36,10 +36,24 @@
 #define NOAUTOEXEC
  */
 
+/* platform limitations (NOFSYNC: no fsync(), ftruncate() or fcntl()
+   locks; NOSOCKETS: no Unix-domain sockets for -daemon) */
+
+/*
+#define NOTHREADS
+#define NOMMAP
+#define NOFSYNC
+#define NOSOCKETS
+ */
+
 #define PTRCONST const
 
 #if defined(__riscos) || defined(__riscos__)
 #define BBCGFX
+#define NOTHREADS
+#define NOMMAP
+#define NOFSYNC
+#define NOSOCKETS
 
 /* a bug fix */
 #ifdef __EASY_C
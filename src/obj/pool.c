@@ -0,0 +1,276 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ *  Nonogram - Terminal-based Nonogram solver
+ *  Copyright (C) 2001,2005-7,2012  Steven Simpson
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  Contact Steven Simpson <https://github.com/simpsonst>
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef NOTHREADS
+#include <unistd.h>
+#endif
+
+#include "context.h"
+#include "pool.h"
+
+unsigned pool_defaultthreads(void)
+{
+#if !defined(NOTHREADS) && defined(_SC_NPROCESSORS_ONLN)
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  if (n > 0)
+    return n;
+#endif
+  return 1;
+}
+
+#ifndef NOTHREADS
+#ifdef __GLIBC__
+/* Hold a job's output until its turn comes, or until it has held
+   POOL_BUFMAX bytes, when it waits for its turn.  Once its turn has
+   come, it writes straight to the output. */
+static ssize_t writejob(void *vj, const char *data, size_t len)
+{
+  struct pool_job *j = vj;
+  struct pool *p = j->pool;
+  char *nbuf;
+
+  if (!j->direct) {
+    pthread_mutex_lock(&p->lock);
+    while ((p->first != j || p->busy) && j->len + len > POOL_BUFMAX)
+      pthread_cond_wait(&p->turn, &p->lock);
+    if (p->first == j && !p->busy)
+      j->direct = true;
+    pthread_mutex_unlock(&p->lock);
+
+    if (!j->direct) {
+      nbuf = realloc(j->buf, j->len + len);
+      if (!nbuf)
+        return -1;
+      j->buf = nbuf;
+      memcpy(j->buf + j->len, data, len);
+      j->len += len;
+      return len;
+    }
+
+    if (j->len > 0)
+      fwrite(j->buf, 1, j->len, p->out);
+    free(j->buf);
+    j->buf = NULL;
+    j->len = 0;
+  }
+  return fwrite(data, 1, len, p->out);
+}
+
+static FILE *openjob(struct pool_job *j)
+{
+  static const cookie_io_functions_t funcs = {
+    NULL, &writejob, NULL, NULL
+  };
+
+  return fopencookie(j, "w", funcs);
+}
+#else
+/* Without a way to see writes as they happen, a job's output is held
+   in full until its turn. */
+static FILE *openjob(struct pool_job *j)
+{
+  return open_memstream(&j->buf, &j->len);
+}
+#endif
+
+static void *worker(void *vp)
+{
+  struct pool *p = vp;
+  struct pool_job *j;
+
+  pthread_mutex_lock(&p->lock);
+  for (;;) {
+    while (!p->next && !p->closed)
+      pthread_cond_wait(&p->queued, &p->lock);
+    if (!p->next)
+      break;
+    j = p->next;
+    p->next = j->next;
+    pthread_mutex_unlock(&p->lock);
+
+    if (p->out && !(j->fp = openjob(j)))
+      j->failed = true;
+    else
+      (*p->work)(p->ctxt, j);
+    if (j->fp)
+      fclose(j->fp);
+    j->fp = NULL;
+
+    pthread_mutex_lock(&p->lock);
+    j->done = true;
+    pthread_cond_signal(&p->finished);
+  }
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+
+static void *emitter(void *vp)
+{
+  struct pool *p = vp;
+  struct pool_job *j;
+
+  pthread_mutex_lock(&p->lock);
+  for (;;) {
+    while (!(p->first && p->first->done) && !(p->closed && !p->first))
+      pthread_cond_wait(&p->finished, &p->lock);
+    if (!p->first)
+      break;
+    j = p->first;
+    p->first = j->next;
+    if (!p->first)
+      p->last = NULL;
+    p->busy = true;
+    pthread_mutex_unlock(&p->lock);
+
+    if (j->buf) {
+      fwrite(j->buf, 1, j->len, p->out);
+      free(j->buf);
+    }
+    if (p->emit)
+      (*p->emit)(p->ctxt, j);
+    free(j);
+
+    pthread_mutex_lock(&p->lock);
+    p->pending--;
+    p->busy = false;
+    pthread_cond_signal(&p->room);
+    pthread_cond_broadcast(&p->turn);
+  }
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+#endif
+
+int pool_init(struct pool *p, unsigned threads, FILE *out,
+              pool_proc *work, pool_proc *emit, void *ctxt)
+{
+  p->work = work;
+  p->emit = emit;
+  p->ctxt = ctxt;
+  p->out = out;
+
+#ifndef NOTHREADS
+  if (threads == 0)
+    threads = pool_defaultthreads();
+  p->first = p->last = p->next = NULL;
+  p->pending = 0;
+  p->capacity = threads * 4;
+  p->closed = p->busy = false;
+  p->threads = malloc(threads * sizeof *p->threads);
+  if (!p->threads)
+    return -1;
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->queued, NULL);
+  pthread_cond_init(&p->finished, NULL);
+  pthread_cond_init(&p->room, NULL);
+  pthread_cond_init(&p->turn, NULL);
+
+  p->nthreads = 0;
+  if (pthread_create(&p->emitter, NULL, &emitter, p)) {
+    pthread_cond_destroy(&p->turn);
+    pthread_cond_destroy(&p->room);
+    pthread_cond_destroy(&p->finished);
+    pthread_cond_destroy(&p->queued);
+    pthread_mutex_destroy(&p->lock);
+    free(p->threads);
+    return -1;
+  }
+  while (p->nthreads < threads &&
+         !pthread_create(&p->threads[p->nthreads], NULL, &worker, p))
+    p->nthreads++;
+  if (p->nthreads == 0) {
+    pool_term(p);
+    return -1;
+  }
+#endif
+  return 0;
+}
+
+int pool_submit(struct pool *p, void *data)
+{
+  struct pool_job *j = malloc(sizeof *j);
+
+  if (!j)
+    return -1;
+  j->next = NULL;
+  j->data = data;
+  j->pool = p;
+  j->buf = NULL;
+  j->len = 0;
+  j->done = j->direct = j->failed = false;
+
+#ifdef NOTHREADS
+  /* no workers, so write straight to the output */
+  j->fp = p->out;
+  (*p->work)(p->ctxt, j);
+  j->done = true;
+  if (p->emit)
+    (*p->emit)(p->ctxt, j);
+  free(j);
+#else
+  j->fp = NULL;
+  pthread_mutex_lock(&p->lock);
+  while (p->pending >= p->capacity)
+    pthread_cond_wait(&p->room, &p->lock);
+  if (p->last)
+    p->last->next = j;
+  else
+    p->first = j;
+  p->last = j;
+  if (!p->next)
+    p->next = j;
+  p->pending++;
+  pthread_cond_signal(&p->queued);
+  pthread_mutex_unlock(&p->lock);
+#endif
+  return 0;
+}
+
+void pool_term(struct pool *p)
+{
+#ifndef NOTHREADS
+  unsigned i;
+
+  pthread_mutex_lock(&p->lock);
+  p->closed = true;
+  pthread_cond_broadcast(&p->queued);
+  pthread_cond_broadcast(&p->finished);
+  pthread_mutex_unlock(&p->lock);
+
+  for (i = 0; i < p->nthreads; i++)
+    pthread_join(p->threads[i], NULL);
+  pthread_join(p->emitter, NULL);
+  free(p->threads);
+
+  pthread_cond_destroy(&p->turn);
+  pthread_cond_destroy(&p->room);
+  pthread_cond_destroy(&p->finished);
+  pthread_cond_destroy(&p->queued);
+  pthread_mutex_destroy(&p->lock);
+#endif
+}
@@ -0,0 +1,80 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ *  Nonogram - Terminal-based Nonogram solver
+ *  Copyright (C) 2001,2005-7,2012  Steven Simpson
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  Contact Steven Simpson <https://github.com/simpsonst>
+ */
+
+#ifndef POOL_HEADER
+#define POOL_HEADER
+
+#include <stdio.h>
+
+#include "options.h"
+
+#ifndef NOTHREADS
+#include <pthread.h>
+#endif
+
+/* Jobs are worked on in any order by any worker, but are emitted
+   strictly in the order they were submitted.  Output that a job
+   writes to its fp is held until the jobs before it have been
+   emitted, and then written directly.  A job that has held
+   POOL_BUFMAX bytes waits for its turn before writing more.  A job
+   whose output can't be held isn't worked on, but is emitted with
+   failed set. */
+
+#define POOL_BUFMAX (1024 * 1024)
+
+struct pool;
+
+struct pool_job {
+  struct pool_job *next;
+  struct pool *pool;
+  void *data;
+  FILE *fp;
+  char *buf;
+  size_t len;
+  unsigned done : 1, direct : 1, failed : 1;
+};
+
+typedef void pool_proc(void *ctxt, struct pool_job *j);
+
+struct pool {
+  pool_proc *work, *emit;
+  void *ctxt;
+  FILE *out;
+#ifndef NOTHREADS
+  pthread_mutex_t lock;
+  pthread_cond_t queued, finished, room, turn;
+  struct pool_job *first, *last, *next;
+  size_t pending, capacity;
+  unsigned nthreads;
+  pthread_t *threads, emitter;
+  unsigned closed : 1, busy : 1;
+#endif
+};
+
+unsigned pool_defaultthreads(void);
+int pool_init(struct pool *p, unsigned threads, FILE *out,
+              pool_proc *work, pool_proc *emit, void *ctxt);
+int pool_submit(struct pool *p, void *data);
+void pool_term(struct pool *p);
+
+#endif
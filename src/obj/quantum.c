@@ -0,0 +1,74 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ *  Nonogram - Terminal-based Nonogram solver
+ *  Copyright (C) 2001,2005-7,2012  Steven Simpson
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  Contact Steven Simpson <https://github.com/simpsonst>
+ */
+
+#include "quantum.h"
+#include "timing.h"
+
+void quantum_init(struct quantum *q, int fixed)
+{
+  q->fixed = fixed > 0;
+  q->limited = 0;
+  q->n = fixed > 0 ? fixed : 1;
+}
+
+void quantum_limit(struct quantum *q, unsigned long long steps)
+{
+  q->limited = 1;
+  q->left = steps;
+}
+
+int quantum_spent(const struct quantum *q)
+{
+  return q->limited && q->left == 0;
+}
+
+int quantum_run(struct quantum *q, nonogram_solver *s,
+                unsigned long long *steps)
+{
+  int asked = q->n, tries, rc;
+  double began = q->fixed ? 0.0 : monotime(), took;
+
+  if (q->limited && q->left < (unsigned) asked)
+    asked = q->left;
+  if (asked == 0)
+    return nonogram_UNFINISHED;
+  tries = asked;
+  rc = nonogram_runsolver_n(s, &tries);
+  if (steps)
+    *steps += asked - tries;
+  if (q->limited)
+    q->left -= asked - tries;
+  if (q->fixed || rc == nonogram_FINISHED)
+    return rc;
+
+  /* Ignore calls cut short, e.g., by finding a solution or the
+     limit. */
+  if (tries > 0 || asked < q->n)
+    return rc;
+  took = monotime() - began;
+  if (took < QUANTUM_SLICE / 2 && q->n < QUANTUM_MAX)
+    q->n *= 2;
+  else if (took > QUANTUM_SLICE * 2 && q->n > 1)
+    q->n /= 2;
+  return rc;
+}
@@ -0,0 +1,56 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ *  Nonogram - Terminal-based Nonogram solver
+ *  Copyright (C) 2001,2005-7,2012  Steven Simpson
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  Contact Steven Simpson <https://github.com/simpsonst>
+ */
+
+#ifndef QUANTUM_HEADER
+#define QUANTUM_HEADER
+
+#include <nonogram.h>
+
+/* the time aimed for by each adaptive call to the solver */
+#define QUANTUM_SLICE 0.005
+
+#define QUANTUM_MAX (1 << 20)
+
+/* how many steps to ask the solver for at a time */
+struct quantum {
+  int n;
+  unsigned long long left;
+  unsigned fixed : 1, limited : 1;
+};
+
+/* A fixed quantum of 0 adapts to take about QUANTUM_SLICE seconds per
+   call. */
+void quantum_init(struct quantum *q, int fixed);
+
+/* Allow only so many steps over all later calls. */
+void quantum_limit(struct quantum *q, unsigned long long steps);
+
+/* true if the limit has been used up */
+int quantum_spent(const struct quantum *q);
+
+/* Run the solver for one quantum, returning its status, and adding
+   the steps used to *steps if not NULL. */
+int quantum_run(struct quantum *q, nonogram_solver *s,
+                unsigned long long *steps);
+
+#endif
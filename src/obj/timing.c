@@ -0,0 +1,52 @@
+// -*- c-basic-offset: 2; indent-tabs-mode: nil -*-
+
+/*
+ *  Nonogram - Terminal-based Nonogram solver
+ *  Copyright (C) 2001,2005-7,2012  Steven Simpson
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  Contact Steven Simpson <https://github.com/simpsonst>
+ */
+
+#include <time.h>
+#include <unistd.h>
+
+#if defined(_POSIX_VERSION)
+#include <sys/time.h>
+#endif
+
+#include "timing.h"
+
+double monotime(void)
+{
+#if defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+#if defined(_POSIX_VERSION)
+  {
+    struct timeval tv;
+
+    /* Wall-clock time may be stepped, but unlike clock(), it counts
+       time spent waiting, and isn't the sum of all threads' work. */
+    if (gettimeofday(&tv, NULL) == 0)
+      return tv.tv_sec + tv.tv_usec / 1e6;
+  }
+#endif
+  return (double) clock() / CLOCKS_PER_SEC;
+}